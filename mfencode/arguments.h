@@ -16,7 +16,7 @@ struct Arguments
     // [argument, positional]
     // [value_description: path]
     // The path of the output AAC file. If not specified, it will be the input path with the
-    // extension replaced by '.m4a'.
+    // extension replaced by '.m4a'. With -Batch, this is the directory for the output files.
     std::wstring Output;
 
     // [argument, positional, default: 2]
@@ -24,6 +24,94 @@ struct Arguments
     // 1: 96kbps; 2: 128kbps; 3: 160kbps; 4: 192kbps;
     int Quality;
 
+    // [argument]
+    // Measures the integrated loudness, loudness range and true peak of the input according to
+    // EBU R128 while encoding.
+    bool Loudness;
+
+    // [argument]
+    // [value_description: LUFS]
+    // Normalizes the output to the specified integrated loudness, e.g. -16 or -23. The input is
+    // decoded once into a temporary cache to measure it, and the gain is limited so the true peak
+    // of the output does not exceed -1 dBTP.
+    std::optional<float> NormalizeLoudness;
+
+    // [argument]
+    // [value_description: path]
+    // Writes a file with minimum and maximum waveform peaks at 256, 1024 and 4096 samples per
+    // pixel to the specified path while encoding.
+    std::wstring Peaks;
+
+    // [argument]
+    // Reports ranges of silence in the input that are at least as long as -SilenceDuration.
+    bool DetectSilence;
+
+    // [argument]
+    // Removes leading and trailing silence from the output, and reports ranges of silence like
+    // -DetectSilence.
+    bool TrimSilence;
+
+    // [argument, default: -60]
+    // [value_description: dBFS]
+    // The level below which audio is considered silent.
+    float SilenceThreshold;
+
+    // [argument, default: 2]
+    // [value_description: seconds]
+    // The minimum duration of a reported silent range.
+    float SilenceDuration;
+
+    // [argument]
+    // Treats the input as a UTF-8 text file listing media files, one per line, which are encoded
+    // into a single output with a chapter for each file. All files are converted to the sample
+    // rate and channel count of the first one. At most 255 files can be listed.
+    bool Concatenate;
+
+    // [argument]
+    // Treats the input as a UTF-8 text file listing media files, one per line, which are each
+    // encoded to an '.m4a' file. Several files are encoded at the same time. Cannot be combined
+    // with options that need access to the samples, such as -Loudness.
+    bool Batch;
+
+    // [argument, default: 0]
+    // [value_description: count]
+    // The maximum number of files encoded at the same time with -Batch. If zero, the number of
+    // processors is used.
+    int Jobs;
+
+    // [argument]
+    // [value_description: path]
+    // A directory in which encoded outputs are cached, keyed by a hash of the decoded audio and
+    // the quality. The input is decoded once to compute the hash, and if the same audio was
+    // encoded before, even from a different file format, the output is copied from the cache.
+    // Cannot be combined with -Concatenate or options that need access to the samples.
+    std::wstring Cache;
+
+    // [argument, default: 4096]
+    // [value_description: MB]
+    // The maximum size of the -Cache directory. When it is exceeded, the least recently used
+    // outputs are removed.
+    int CacheSize;
+
+    // [argument]
+    // Encodes in segments of about a minute, recording progress in a checkpoint file next to the
+    // output. If the encode is interrupted, running the same command again continues after the
+    // last completed segment, and replaces any partial output without needing -Force. Cannot be
+    // combined with -Batch, -Cache, -Concatenate or options that need access to the samples.
+    bool Resumable;
+
+    // [argument]
+    // Reads the input from the shared memory ring buffer whose name is given as the input path,
+    // instead of from a file. An output path must be specified.
+    bool RingInput;
+
+    // [argument]
+    // [value_description: name]
+    // Decodes the input into a shared memory ring buffer with the specified name, for another
+    // instance started with -RingInput, instead of encoding it. This is a reference producer for
+    // testing.
+    std::wstring FeedRing;
+
     // [argument, alias: f]
     // Overwrite the output file if it exists.
     bool Force;
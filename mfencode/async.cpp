@@ -0,0 +1,215 @@
+// This file doesn't use the precompiled header, so it can be built and tested on other platforms.
+#include "async.h"
+
+#include <algorithm>
+
+namespace async
+{
+
+void Executor::Post(std::coroutine_handle<> handle)
+{
+    {
+        std::lock_guard lock{m_mutex};
+        m_ready.push_back(handle);
+    }
+
+    m_condition.notify_one();
+}
+
+void Executor::PostAfter(std::chrono::steady_clock::duration delay, std::coroutine_handle<> handle)
+{
+    {
+        std::lock_guard lock{m_mutex};
+        m_timers.push({ std::chrono::steady_clock::now() + delay, handle });
+    }
+
+    m_condition.notify_one();
+}
+
+void Executor::Spawn(Task<> task)
+{
+    {
+        std::lock_guard lock{m_mutex};
+        ++m_runningTasks;
+    }
+
+    auto detached = RunDetached(std::move(task));
+    detached.Handle.promise().CurrentExecutor = this;
+    Post(detached.Handle);
+}
+
+void Executor::Run()
+{
+    for (;;)
+    {
+        std::coroutine_handle<> next;
+        {
+            std::unique_lock lock{m_mutex};
+            for (;;)
+            {
+                auto now = std::chrono::steady_clock::now();
+                while (!m_timers.empty() && m_timers.top().Due <= now)
+                {
+                    m_ready.push_back(m_timers.top().Handle);
+                    m_timers.pop();
+                }
+
+                if (!m_ready.empty())
+                {
+                    next = m_ready.front();
+                    m_ready.pop_front();
+                    break;
+                }
+
+                if (m_runningTasks == 0)
+                {
+                    if (m_exception)
+                    {
+                        std::rethrow_exception(std::exchange(m_exception, nullptr));
+                    }
+
+                    return;
+                }
+
+                if (m_timers.empty())
+                {
+                    m_condition.wait(lock);
+                }
+                else
+                {
+                    m_condition.wait_until(lock, m_timers.top().Due);
+                }
+            }
+        }
+
+        next.resume();
+    }
+}
+
+details::DetachedTask Executor::RunDetached(Task<> task)
+{
+    std::exception_ptr exception;
+    try
+    {
+        co_await task;
+    }
+    catch (...)
+    {
+        exception = std::current_exception();
+    }
+
+    OnTaskFinished(exception);
+}
+
+void Executor::OnTaskFinished(std::exception_ptr exception)
+{
+    {
+        std::lock_guard lock{m_mutex};
+        if (exception && !m_exception)
+        {
+            m_exception = exception;
+        }
+
+        --m_runningTasks;
+    }
+
+    m_condition.notify_one();
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    threadCount = std::max<size_t>(threadCount, 1);
+    m_threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        m_threads.emplace_back([this](std::stop_token stopToken) { Run(stopToken); });
+    }
+}
+
+void ThreadPool::Post(std::coroutine_handle<> handle)
+{
+    {
+        std::lock_guard lock{m_mutex};
+        m_queue.push_back(handle);
+    }
+
+    m_condition.notify_one();
+}
+
+void ThreadPool::Run(std::stop_token stopToken)
+{
+    for (;;)
+    {
+        std::coroutine_handle<> next;
+        {
+            std::unique_lock lock{m_mutex};
+            if (!m_condition.wait(lock, stopToken, [this]() { return !m_queue.empty(); }))
+            {
+                return;
+            }
+
+            next = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        next.resume();
+    }
+}
+
+void CompletionEvent::SetCompleted(std::exception_ptr exception)
+{
+    std::vector<std::pair<std::coroutine_handle<>, Executor *>> waiters;
+    {
+        std::lock_guard lock{m_mutex};
+        if (m_completed)
+        {
+            return;
+        }
+
+        m_completed = true;
+        m_exception = exception;
+        waiters.swap(m_waiters);
+    }
+
+    for (auto [handle, executor] : waiters)
+    {
+        if (executor != nullptr)
+        {
+            executor->Post(handle);
+        }
+        else
+        {
+            handle.resume();
+        }
+    }
+}
+
+bool CompletionEvent::IsCompleted() const
+{
+    std::lock_guard lock{m_mutex};
+    return m_completed;
+}
+
+bool CompletionEvent::AddWaiter(std::coroutine_handle<> handle, Executor *executor)
+{
+    std::lock_guard lock{m_mutex};
+    if (m_completed)
+    {
+        // Completed after await_ready checked; continue without suspending.
+        return false;
+    }
+
+    m_waiters.emplace_back(handle, executor);
+    return true;
+}
+
+void CompletionEvent::CheckResult() const
+{
+    std::lock_guard lock{m_mutex};
+    if (m_exception)
+    {
+        std::rethrow_exception(m_exception);
+    }
+}
+
+}
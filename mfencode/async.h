@@ -0,0 +1,382 @@
+#pragma once
+
+// Coroutine support for driving many sessions from a single thread. This only depends on the
+// standard library.
+#include <chrono>
+#include <coroutine>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace async
+{
+
+class Executor;
+
+namespace details
+{
+
+    struct PromiseBase
+    {
+        // The executor that the coroutine resumes on after waiting for an event.
+        Executor *CurrentExecutor{};
+        std::coroutine_handle<> Continuation;
+        std::exception_ptr Exception;
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                auto continuation = handle.promise().Continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept
+            {
+            }
+        };
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception()
+        {
+            Exception = std::current_exception();
+        }
+    };
+
+    template<typename T>
+    struct Promise : PromiseBase
+    {
+        std::optional<T> Value;
+
+        template<typename U>
+        void return_value(U &&value)
+        {
+            Value.emplace(std::forward<U>(value));
+        }
+
+        T GetResult()
+        {
+            if (Exception)
+            {
+                std::rethrow_exception(Exception);
+            }
+
+            return std::move(*Value);
+        }
+    };
+
+    template<>
+    struct Promise<void> : PromiseBase
+    {
+        void return_void()
+        {
+        }
+
+        void GetResult()
+        {
+            if (Exception)
+            {
+                std::rethrow_exception(Exception);
+            }
+        }
+    };
+
+    // Runs a spawned task to completion and then destroys itself.
+    struct DetachedTask
+    {
+        struct promise_type : PromiseBase
+        {
+            DetachedTask get_return_object()
+            {
+                return { std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+
+            std::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void()
+            {
+            }
+        };
+
+        std::coroutine_handle<promise_type> Handle;
+    };
+
+}
+
+// A lazily started coroutine that produces a value of type T. It starts when awaited, and inherits
+// the executor of the awaiting coroutine.
+template<typename T = void>
+class [[nodiscard]] Task
+{
+public:
+    struct promise_type : details::Promise<T>
+    {
+        Task get_return_object()
+        {
+            return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+    };
+
+    Task(Task &&other) noexcept
+        : m_handle{std::exchange(other.m_handle, {})}
+    {
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+
+            m_handle = std::exchange(other.m_handle, {});
+        }
+
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> caller) noexcept
+    {
+        m_handle.promise().Continuation = caller;
+        m_handle.promise().CurrentExecutor = caller.promise().CurrentExecutor;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        return m_handle.promise().GetResult();
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle)
+        : m_handle{handle}
+    {
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Resumes coroutines on the thread that calls Run. Coroutines that wait for a CompletionEvent are
+// resumed here, regardless of which thread completed the event.
+class Executor
+{
+public:
+    void Post(std::coroutine_handle<> handle);
+    void PostAfter(std::chrono::steady_clock::duration delay, std::coroutine_handle<> handle);
+
+    // Starts a task that runs independently. Run returns once all spawned tasks have finished.
+    void Spawn(Task<> task);
+
+    // Runs until all spawned tasks have finished. If any of them failed, the first exception is
+    // rethrown.
+    void Run();
+
+    // Returns an awaitable that continues the coroutine on this executor.
+    auto Schedule()
+    {
+        struct Awaiter
+        {
+            Executor &Owner;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                Owner.Post(handle);
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+
+        return Awaiter{*this};
+    }
+
+    // Returns an awaitable that continues the coroutine on this executor after the delay.
+    auto Delay(std::chrono::steady_clock::duration delay)
+    {
+        struct Awaiter
+        {
+            Executor &Owner;
+            std::chrono::steady_clock::duration Delay;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                Owner.PostAfter(Delay, handle);
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+
+        return Awaiter{*this, delay};
+    }
+
+private:
+    struct Timer
+    {
+        std::chrono::steady_clock::time_point Due;
+        std::coroutine_handle<> Handle;
+
+        bool operator>(const Timer &other) const
+        {
+            return Due > other.Due;
+        }
+    };
+
+    details::DetachedTask RunDetached(Task<> task);
+    void OnTaskFinished(std::exception_ptr exception);
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::coroutine_handle<>> m_ready;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers;
+    size_t m_runningTasks{};
+    std::exception_ptr m_exception;
+};
+
+// A fixed number of threads for CPU-bound work. A coroutine moves to the pool with
+// co_await pool.Schedule(), and back with co_await executor.Schedule().
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+
+    void Post(std::coroutine_handle<> handle);
+
+    auto Schedule()
+    {
+        struct Awaiter
+        {
+            ThreadPool &Owner;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                Owner.Post(handle);
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+
+        return Awaiter{*this};
+    }
+
+private:
+    void Run(std::stop_token stopToken);
+
+    std::mutex m_mutex;
+    std::condition_variable_any m_condition;
+    std::deque<std::coroutine_handle<>> m_queue;
+    // Must be last so the threads are joined before the other members are destroyed.
+    std::vector<std::jthread> m_threads;
+};
+
+// An event that completes once, optionally with an exception, and can be completed from any
+// thread. Awaiting coroutines are resumed on their executor, and the exception is rethrown to them.
+class CompletionEvent
+{
+public:
+    void SetCompleted(std::exception_ptr exception = nullptr);
+    bool IsCompleted() const;
+
+    class Awaiter
+    {
+    public:
+        explicit Awaiter(CompletionEvent &event)
+            : m_event{event}
+        {
+        }
+
+        bool await_ready() const
+        {
+            return m_event.IsCompleted();
+        }
+
+        template<typename Promise>
+        bool await_suspend(std::coroutine_handle<Promise> handle)
+        {
+            return m_event.AddWaiter(handle, handle.promise().CurrentExecutor);
+        }
+
+        void await_resume() const
+        {
+            m_event.CheckResult();
+        }
+
+    private:
+        CompletionEvent &m_event;
+    };
+
+    Awaiter operator co_await()
+    {
+        return Awaiter{*this};
+    }
+
+private:
+    bool AddWaiter(std::coroutine_handle<> handle, Executor *executor);
+    void CheckResult() const;
+
+    mutable std::mutex m_mutex;
+    bool m_completed{};
+    std::exception_ptr m_exception;
+    std::vector<std::pair<std::coroutine_handle<>, Executor *>> m_waiters;
+};
+
+}
@@ -0,0 +1,123 @@
+#include "precomp.h"
+#include "audio.h"
+#include "simd.h"
+
+namespace audio
+{
+
+// Number of frames returned by a single ReadBlock call on a MappedPcmReader.
+constexpr UINT64 c_mappedBlockFrames = 0x10000;
+// Number of frames in each mapped view. Because this is a multiple of 64K, the view offset always
+// satisfies the allocation granularity requirement of MapViewOfFile.
+constexpr UINT64 c_mappedViewFrames = 0x100000;
+
+PcmCache::PcmCache(const AudioFormat &format)
+    : m_format{format}
+{
+    wchar_t tempPath[MAX_PATH + 1];
+    THROW_LAST_ERROR_IF(GetTempPathW(static_cast<DWORD>(std::size(tempPath)), tempPath) == 0);
+    wchar_t tempFile[MAX_PATH];
+    THROW_LAST_ERROR_IF(GetTempFileNameW(tempPath, L"mfe", 0, tempFile) == 0);
+    m_file.reset(CreateFileW(tempFile, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr));
+
+    THROW_LAST_ERROR_IF(!m_file);
+}
+
+void PcmCache::ProcessSamples(std::span<const float> samples)
+{
+    auto data = reinterpret_cast<const BYTE *>(samples.data());
+    auto remaining = samples.size_bytes();
+    while (remaining > 0)
+    {
+        DWORD written;
+        auto size = static_cast<DWORD>(std::min<size_t>(remaining, MAXDWORD));
+        THROW_IF_WIN32_BOOL_FALSE(WriteFile(m_file.get(), data, size, &written, nullptr));
+        data += written;
+        remaining -= written;
+        m_size += written;
+    }
+}
+
+std::unique_ptr<ISampleReader> PcmCache::CreateReader()
+{
+    return std::make_unique<MappedPcmReader>(m_file.get(), m_size, m_format);
+}
+
+MappedPcmReader::MappedPcmReader(HANDLE file, UINT64 size, const AudioFormat &format)
+    : m_format{format},
+      m_size{size}
+{
+    // Mapping an empty file is not allowed; ReadBlock will just return end of stream.
+    if (m_size > 0)
+    {
+        m_mapping.reset(CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr));
+        THROW_LAST_ERROR_IF(!m_mapping);
+    }
+}
+
+std::span<const float> MappedPcmReader::ReadBlock()
+{
+    if (m_position >= m_size)
+    {
+        return {};
+    }
+
+    if (!m_view || m_position >= m_viewOffset + m_viewSize)
+    {
+        m_view.reset();
+        m_viewOffset = m_position;
+        m_viewSize = std::min(c_mappedViewFrames * m_format.GetFrameSize(), m_size - m_viewOffset);
+        m_view.reset(MapViewOfFile(m_mapping.get(), FILE_MAP_READ, static_cast<DWORD>(m_viewOffset >> 32),
+                                   static_cast<DWORD>(m_viewOffset), static_cast<SIZE_T>(m_viewSize)));
+
+        THROW_LAST_ERROR_IF(!m_view);
+    }
+
+    auto offset = m_position - m_viewOffset;
+    auto size = std::min(c_mappedBlockFrames * m_format.GetFrameSize(), m_viewSize - offset);
+    m_position += size;
+    auto data = reinterpret_cast<const float *>(static_cast<const BYTE *>(m_view.get()) + offset);
+    return { data, static_cast<size_t>(size / sizeof(float)) };
+}
+
+AudioFormat MappedPcmReader::GetFormat() const
+{
+    return m_format;
+}
+
+util::WindowsTimeUnits MappedPcmReader::GetDuration() const
+{
+    return FramesToDuration(m_size / m_format.GetFrameSize(), m_format.SamplesPerSecond);
+}
+
+void ConvertToInt16(std::span<const float> samples, int16_t *output, float gain)
+{
+    auto scale = gain * 32768.0f;
+    auto scaleVector = simd::Set1(scale);
+    size_t i = 0;
+    for (; i + 8 <= samples.size(); i += 8)
+    {
+        auto low = simd::Mul(simd::Load(samples.data() + i), scaleVector);
+        auto high = simd::Mul(simd::Load(samples.data() + i + 4), scaleVector);
+        simd::StoreInt16(output + i, low, high);
+    }
+
+    for (; i < samples.size(); ++i)
+    {
+        auto value = std::lround(samples[i] * scale);
+        output[i] = static_cast<int16_t>(std::clamp(value, -32768L, 32767L));
+    }
+}
+
+float DecibelsToGain(double decibels)
+{
+    return static_cast<float>(std::pow(10.0, decibels / 20.0));
+}
+
+util::WindowsTimeUnits FramesToDuration(UINT64 frames, UINT32 samplesPerSecond)
+{
+    return util::WindowsTimeUnits{static_cast<long long>(frames * wil::filetime_duration::one_second / samplesPerSecond)};
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "util.h"
+
+namespace audio
+{
+
+struct AudioFormat
+{
+    UINT32 SamplesPerSecond;
+    UINT32 Channels;
+
+    UINT32 GetFrameSize() const
+    {
+        return Channels * sizeof(float);
+    }
+
+    bool operator==(const AudioFormat &) const = default;
+};
+
+// Provides blocks of decoded audio as interleaved 32-bit float samples.
+class ISampleReader
+{
+public:
+    virtual ~ISampleReader() = default;
+
+    // Returns the next block of samples, or an empty span at the end of the stream. The returned
+    // span remains valid until the next call to ReadBlock.
+    virtual std::span<const float> ReadBlock() = 0;
+    virtual AudioFormat GetFormat() const = 0;
+    virtual util::WindowsTimeUnits GetDuration() const = 0;
+};
+
+// Receives every block of samples that passes through a SampleTranscodeSession.
+class ISampleProcessor
+{
+public:
+    virtual ~ISampleProcessor() = default;
+
+    virtual void ProcessSamples(std::span<const float> samples) = 0;
+};
+
+// Caches decoded samples in a temporary file so they can be read back without decoding the input
+// again. The file is deleted when the cache is destroyed.
+class PcmCache final : public ISampleProcessor
+{
+public:
+    PcmCache(const AudioFormat &format);
+
+    void ProcessSamples(std::span<const float> samples) override;
+
+    std::unique_ptr<ISampleReader> CreateReader();
+
+private:
+    wil::unique_hfile m_file;
+    AudioFormat m_format;
+    UINT64 m_size{};
+};
+
+// Reads samples back from a PcmCache using a sliding memory-mapped view.
+class MappedPcmReader final : public ISampleReader
+{
+public:
+    MappedPcmReader(HANDLE file, UINT64 size, const AudioFormat &format);
+
+    std::span<const float> ReadBlock() override;
+    AudioFormat GetFormat() const override;
+    util::WindowsTimeUnits GetDuration() const override;
+
+private:
+    wil::unique_handle m_mapping;
+    wil::unique_mapview_ptr<void> m_view;
+    AudioFormat m_format;
+    UINT64 m_size;
+    UINT64 m_viewOffset{};
+    UINT64 m_viewSize{};
+    UINT64 m_position{};
+};
+
+// Converts float samples to 16-bit PCM, applying the specified linear gain.
+void ConvertToInt16(std::span<const float> samples, int16_t *output, float gain);
+
+float DecibelsToGain(double decibels);
+
+util::WindowsTimeUnits FramesToDuration(UINT64 frames, UINT32 samplesPerSecond);
+
+}
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "precomp.h"
+#include "chapters.h"
+
+namespace mp4
+{
+
+constexpr size_t c_maxTitleLength = 255;
+constexpr UINT32 c_boxHeaderSize = 8;
+
+namespace
+{
+
+void AppendUInt32(std::vector<char> &buffer, UINT32 value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        buffer.push_back(static_cast<char>(value >> shift));
+    }
+}
+
+void AppendUInt64(std::vector<char> &buffer, UINT64 value)
+{
+    AppendUInt32(buffer, static_cast<UINT32>(value >> 32));
+    AppendUInt32(buffer, static_cast<UINT32>(value));
+}
+
+UINT32 ReadUInt32(const char *data)
+{
+    auto bytes = reinterpret_cast<const BYTE *>(data);
+    return (static_cast<UINT32>(bytes[0]) << 24) | (static_cast<UINT32>(bytes[1]) << 16)
+        | (static_cast<UINT32>(bytes[2]) << 8) | bytes[3];
+}
+
+UINT64 ReadUInt64(const char *data)
+{
+    return (static_cast<UINT64>(ReadUInt32(data)) << 32) | ReadUInt32(data + 4);
+}
+
+void AppendBox(std::vector<char> &buffer, const char *type, std::span<const char> payload)
+{
+    AppendUInt32(buffer, static_cast<UINT32>(payload.size() + c_boxHeaderSize));
+    buffer.insert(buffer.end(), type, type + 4);
+    buffer.insert(buffer.end(), payload.begin(), payload.end());
+}
+
+std::string ToUtf8(std::wstring_view value)
+{
+    if (value.empty())
+    {
+        return {};
+    }
+
+    auto size = WideCharToMultiByte(CP_UTF8, 0, value.data(), static_cast<int>(value.size()), nullptr, 0, nullptr, nullptr);
+    THROW_LAST_ERROR_IF(size == 0);
+    std::string result(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, value.data(), static_cast<int>(value.size()), result.data(), size, nullptr, nullptr);
+    return result;
+}
+
+std::vector<char> CreateChapterList(std::span<const Chapter> chapters)
+{
+    std::vector<char> payload;
+    auto count = std::min(chapters.size(), c_maxChapters);
+    AppendUInt32(payload, 0x01000000); // Version 1, no flags.
+    AppendUInt32(payload, 0); // Reserved.
+    payload.push_back(static_cast<char>(count));
+    for (const auto &chapter : chapters.first(count))
+    {
+        // Truncate long titles without splitting a UTF-8 sequence.
+        auto title = ToUtf8(chapter.Title);
+        if (title.size() > c_maxTitleLength)
+        {
+            auto length = c_maxTitleLength;
+            while (length > 0 && (static_cast<BYTE>(title[length]) & 0xc0) == 0x80)
+            {
+                --length;
+            }
+
+            title.resize(length);
+        }
+
+        AppendUInt64(payload, static_cast<UINT64>(chapter.Start.count()));
+        payload.push_back(static_cast<char>(title.size()));
+        payload.insert(payload.end(), title.begin(), title.end());
+    }
+
+    std::vector<char> result;
+    AppendBox(result, "chpl", payload);
+    return result;
+}
+
+}
+
+void WriteChapters(const std::filesystem::path &path, std::span<const Chapter> chapters)
+{
+    std::fstream file;
+    file.exceptions(std::ios::failbit | std::ios::badbit);
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    auto fileSize = std::filesystem::file_size(path);
+
+    // Find the movie box among the top-level boxes.
+    UINT64 offset = 0;
+    UINT64 boxSize = 0;
+    UINT32 headerSize = 0;
+    bool found = false;
+    while (offset + c_boxHeaderSize <= fileSize)
+    {
+        char header[16];
+        file.seekg(offset);
+        file.read(header, c_boxHeaderSize);
+        boxSize = ReadUInt32(header);
+        headerSize = c_boxHeaderSize;
+        if (boxSize == 1)
+        {
+            file.read(header + c_boxHeaderSize, 8);
+            boxSize = ReadUInt64(header + c_boxHeaderSize);
+            headerSize += 8;
+        }
+        else if (boxSize == 0)
+        {
+            boxSize = fileSize - offset;
+        }
+
+        if (boxSize < headerSize)
+        {
+            break;
+        }
+
+        if (std::equal(header + 4, header + 8, "moov"))
+        {
+            found = true;
+            break;
+        }
+
+        offset += boxSize;
+    }
+
+    if (!found)
+    {
+        throw std::runtime_error("The output file does not contain a movie box.");
+    }
+
+    std::vector<char> movie(static_cast<size_t>(boxSize - headerSize));
+    file.seekg(offset + headerSize);
+    file.read(movie.data(), movie.size());
+
+    // Copy the children of the movie box, adding the chapter list to the user data box, or
+    // creating one if there isn't any.
+    auto chapterList = CreateChapterList(chapters);
+    std::vector<char> payload;
+    bool hasUserData = false;
+    for (size_t position = 0; position + c_boxHeaderSize <= movie.size();)
+    {
+        auto childSize = static_cast<size_t>(ReadUInt32(movie.data() + position));
+        if (childSize < c_boxHeaderSize || position + childSize > movie.size())
+        {
+            throw std::runtime_error("The output file contains an invalid movie box.");
+        }
+
+        std::span<const char> child{ movie.data() + position, childSize };
+        if (std::equal(child.begin() + 4, child.begin() + 8, "udta"))
+        {
+            std::vector<char> userData{ child.begin() + c_boxHeaderSize, child.end() };
+            userData.insert(userData.end(), chapterList.begin(), chapterList.end());
+            AppendBox(payload, "udta", userData);
+            hasUserData = true;
+        }
+        else
+        {
+            payload.insert(payload.end(), child.begin(), child.end());
+        }
+
+        position += childSize;
+    }
+
+    if (!hasUserData)
+    {
+        AppendBox(payload, "udta", chapterList);
+    }
+
+    std::vector<char> newMovie;
+    AppendBox(newMovie, "moov", payload);
+    file.seekp(offset + 4);
+    file.write("free", 4);
+    file.seekp(0, std::ios::end);
+    file.write(newMovie.data(), newMovie.size());
+}
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "util.h"
+
+namespace mp4
+{
+
+struct Chapter
+{
+    util::WindowsTimeUnits Start;
+    std::wstring Title;
+};
+
+// The most chapters a chapter list can store.
+constexpr size_t c_maxChapters = 255;
+
+// Adds a Nero chapter list ("chpl" box) to an existing MPEG-4 file. The movie box is rewritten at
+// the end of the file and the original is turned into a free box, so no sample offsets change.
+// Chapters past c_maxChapters are ignored.
+void WriteChapters(const std::filesystem::path &path, std::span<const Chapter> chapters);
+
+}
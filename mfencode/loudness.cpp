@@ -0,0 +1,290 @@
+#include "precomp.h"
+#include "loudness.h"
+#include "simd.h"
+
+namespace audio
+{
+
+constexpr double c_pi = 3.14159265358979323846;
+constexpr double c_absoluteGate = -70.0;
+constexpr double c_integratedRelativeGate = -10.0;
+constexpr double c_rangeRelativeGate = -20.0;
+constexpr size_t c_subBlocksPerSecond = 10;
+constexpr size_t c_momentarySubBlocks = 4;
+constexpr size_t c_shortTermSubBlocks = 30;
+
+namespace
+{
+
+double EnergyToLoudness(double energy)
+{
+    if (energy <= 0.0)
+    {
+        return -std::numeric_limits<double>::infinity();
+    }
+
+    return -0.691 + 10.0 * std::log10(energy);
+}
+
+// Computes the mean of every window of the specified size, moving one sub-block at a time.
+std::vector<double> GetWindowEnergies(const std::vector<double> &subBlocks, size_t windowSize)
+{
+    std::vector<double> result;
+    if (subBlocks.size() < windowSize)
+    {
+        return result;
+    }
+
+    result.reserve(subBlocks.size() - windowSize + 1);
+    double sum = std::accumulate(subBlocks.begin(), subBlocks.begin() + windowSize, 0.0);
+    result.push_back(sum / windowSize);
+    for (size_t i = windowSize; i < subBlocks.size(); ++i)
+    {
+        sum += subBlocks[i] - subBlocks[i - windowSize];
+        result.push_back(sum / windowSize);
+    }
+
+    return result;
+}
+
+double GatedMeanEnergy(const std::vector<double> &energies, double threshold)
+{
+    double sum{};
+    size_t count{};
+    for (auto energy : energies)
+    {
+        if (EnergyToLoudness(energy) > threshold)
+        {
+            sum += energy;
+            ++count;
+        }
+    }
+
+    return count == 0 ? 0.0 : sum / count;
+}
+
+}
+
+LoudnessMeter::LoudnessMeter(const AudioFormat &format)
+    : m_format{format},
+      m_subBlockFrames{format.SamplesPerSecond / c_subBlocksPerSecond}
+{
+    // K-weighting filter coefficients, derived for the actual sample rate from the analog
+    // prototypes of the BS.1770 pre-filter and RLB high-pass filter.
+    double rate = format.SamplesPerSecond;
+    double k = std::tan(c_pi * 1681.974450955533 / rate);
+    double q = 0.7071752369554196;
+    double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    m_shelf = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+    k = std::tan(c_pi * 38.13547087602444 / rate);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    m_highPass = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+    // Channel weights assume the standard Media Foundation channel order. The LFE channel of a 5.1
+    // stream is excluded, and surround channels get a +1.5dB weight.
+    m_weights.assign(format.Channels + (format.Channels % 2), 1.0);
+    if (format.Channels == 6)
+    {
+        m_weights[3] = 0.0;
+        m_weights[4] = m_weights[5] = 1.41;
+    }
+    else if (format.Channels == 5)
+    {
+        m_weights[3] = m_weights[4] = 1.41;
+    }
+
+    m_pairs.resize((format.Channels + 1) / 2);
+    m_peaks.resize(format.Channels);
+
+    // Windowed-sinc interpolation filter; the phases are normalized to unity gain.
+    constexpr size_t totalTaps = c_peakTaps * 4;
+    for (size_t phase = 0; phase < 4; ++phase)
+    {
+        double sum{};
+        for (size_t tap = 0; tap < c_peakTaps; ++tap)
+        {
+            auto n = tap * 4 + phase;
+            auto x = (static_cast<double>(n) - (totalTaps - 1) / 2.0) / 4.0;
+            auto sinc = x == 0.0 ? 1.0 : std::sin(c_pi * x) / (c_pi * x);
+            auto window = 0.42 - 0.5 * std::cos(2.0 * c_pi * n / (totalTaps - 1))
+                + 0.08 * std::cos(4.0 * c_pi * n / (totalTaps - 1));
+
+            m_peakCoefficients[tap][phase] = static_cast<float>(sinc * window);
+            sum += sinc * window;
+        }
+
+        for (size_t tap = 0; tap < c_peakTaps; ++tap)
+        {
+            m_peakCoefficients[tap][phase] = static_cast<float>(m_peakCoefficients[tap][phase] / sum);
+        }
+    }
+}
+
+void LoudnessMeter::ProcessSamples(std::span<const float> samples)
+{
+    ProcessTruePeak(samples, samples.size() / m_format.Channels);
+
+    // Split the block at sub-block boundaries.
+    while (samples.size() >= m_format.Channels)
+    {
+        auto frames = std::min(samples.size() / m_format.Channels, m_subBlockFrames - m_subBlockPosition);
+        ProcessEnergy(samples, frames);
+        samples = samples.subspan(frames * m_format.Channels);
+        m_subBlockPosition += frames;
+        if (m_subBlockPosition == m_subBlockFrames)
+        {
+            EndSubBlock();
+        }
+    }
+}
+
+LoudnessResult LoudnessMeter::GetResult() const
+{
+    LoudnessResult result{};
+
+    auto blocks = GetWindowEnergies(m_subBlocks, c_momentarySubBlocks);
+    auto relativeGate = EnergyToLoudness(GatedMeanEnergy(blocks, c_absoluteGate)) + c_integratedRelativeGate;
+    result.IntegratedLoudness = EnergyToLoudness(GatedMeanEnergy(blocks, std::max(c_absoluteGate, relativeGate)));
+
+    auto shortTerm = GetWindowEnergies(m_subBlocks, c_shortTermSubBlocks);
+    relativeGate = EnergyToLoudness(GatedMeanEnergy(shortTerm, c_absoluteGate)) + c_rangeRelativeGate;
+    auto threshold = std::max(c_absoluteGate, relativeGate);
+    std::vector<double> gated;
+    for (auto energy : shortTerm)
+    {
+        auto loudness = EnergyToLoudness(energy);
+        if (loudness > threshold)
+        {
+            gated.push_back(loudness);
+        }
+    }
+
+    if (!gated.empty())
+    {
+        std::sort(gated.begin(), gated.end());
+        auto percentile = [&gated](double p) { return gated[static_cast<size_t>(std::lround((gated.size() - 1) * p))]; };
+        result.LoudnessRange = percentile(0.95) - percentile(0.10);
+    }
+
+    float peak{};
+    for (const auto &state : m_peaks)
+    {
+        peak = std::max({ peak, state.Peak[0], state.Peak[1], state.Peak[2], state.Peak[3] });
+    }
+
+    result.TruePeak = peak > 0.0f ? 20.0 * std::log10(peak) : -std::numeric_limits<double>::infinity();
+    return result;
+}
+
+void LoudnessMeter::ProcessEnergy(std::span<const float> samples, size_t frames)
+{
+    auto channels = m_format.Channels;
+    auto shelfB0 = simd::Set1(m_shelf.B0);
+    auto shelfB1 = simd::Set1(m_shelf.B1);
+    auto shelfB2 = simd::Set1(m_shelf.B2);
+    auto shelfA1 = simd::Set1(-m_shelf.A1);
+    auto shelfA2 = simd::Set1(-m_shelf.A2);
+    auto highPassA1 = simd::Set1(-m_highPass.A1);
+    auto highPassA2 = simd::Set1(-m_highPass.A2);
+    auto minusTwo = simd::Set1(-2.0);
+
+    // Each pair of channels is filtered in one vector, keeping the filter state in registers for
+    // the whole block.
+    for (size_t pair = 0; pair < m_pairs.size(); ++pair)
+    {
+        auto &state = m_pairs[pair];
+        auto shelf1 = simd::Load(state.Shelf[0]);
+        auto shelf2 = simd::Load(state.Shelf[1]);
+        auto highPass1 = simd::Load(state.HighPass[0]);
+        auto highPass2 = simd::Load(state.HighPass[1]);
+        auto energy = simd::Load(state.Energy);
+        const float *input = samples.data() + pair * 2;
+        bool single = pair * 2 + 1 == channels;
+        for (size_t frame = 0; frame < frames; ++frame, input += channels)
+        {
+            auto x = single ? simd::LoadFloat1(input) : simd::LoadFloat2(input);
+
+            // Transposed direct form II.
+            auto y = simd::MulAdd(shelfB0, x, shelf1);
+            shelf1 = simd::MulAdd(shelfA1, y, simd::MulAdd(shelfB1, x, shelf2));
+            shelf2 = simd::MulAdd(shelfA2, y, simd::Mul(shelfB2, x));
+
+            // The high-pass numerator is fixed at 1, -2, 1.
+            auto z = simd::Add(y, highPass1);
+            highPass1 = simd::MulAdd(highPassA1, z, simd::MulAdd(minusTwo, y, highPass2));
+            highPass2 = simd::MulAdd(highPassA2, z, y);
+
+            energy = simd::MulAdd(z, z, energy);
+        }
+
+        simd::Store(state.Shelf[0], shelf1);
+        simd::Store(state.Shelf[1], shelf2);
+        simd::Store(state.HighPass[0], highPass1);
+        simd::Store(state.HighPass[1], highPass2);
+        simd::Store(state.Energy, energy);
+    }
+}
+
+void LoudnessMeter::ProcessTruePeak(std::span<const float> samples, size_t frames)
+{
+    simd::float4 coefficients[c_peakTaps];
+    for (size_t tap = 0; tap < c_peakTaps; ++tap)
+    {
+        coefficients[tap] = simd::Load(m_peakCoefficients[tap]);
+    }
+
+    // All four interpolation phases are computed at once, one per lane.
+    auto channels = m_format.Channels;
+    for (size_t channel = 0; channel < channels; ++channel)
+    {
+        auto &state = m_peaks[channel];
+        auto peak = simd::Load(state.Peak);
+        auto position = state.Position;
+        const float *input = samples.data() + channel;
+        for (size_t frame = 0; frame < frames; ++frame, input += channels)
+        {
+            position = (position + c_peakTaps - 1) % c_peakTaps;
+            state.History[position] = state.History[position + c_peakTaps] = *input;
+            const float *history = state.History + position;
+            auto value = simd::Mul(coefficients[0], simd::Set1(history[0]));
+            for (size_t tap = 1; tap < c_peakTaps; ++tap)
+            {
+                value = simd::MulAdd(coefficients[tap], simd::Set1(history[tap]), value);
+            }
+
+            peak = simd::Max(peak, simd::Max(simd::Abs(value), simd::Abs(simd::Set1(*input))));
+        }
+
+        simd::Store(state.Peak, peak);
+        state.Position = position;
+    }
+}
+
+void LoudnessMeter::EndSubBlock()
+{
+    double energy{};
+    for (size_t pair = 0; pair < m_pairs.size(); ++pair)
+    {
+        auto &state = m_pairs[pair];
+        energy += m_weights[pair * 2] * state.Energy[0] + m_weights[pair * 2 + 1] * state.Energy[1];
+        state.Energy[0] = state.Energy[1] = 0.0;
+    }
+
+    m_subBlocks.push_back(energy / m_subBlockFrames);
+    m_subBlockPosition = 0;
+}
+
+std::wostream &operator<<(std::wostream &stream, const LoudnessResult &result)
+{
+    return stream << std::fixed << std::setprecision(1)
+                  << "integrated loudness: " << result.IntegratedLoudness << " LUFS"
+                  << "; loudness range: " << result.LoudnessRange << " LU"
+                  << "; true peak: " << result.TruePeak << " dBTP";
+}
+
+}
\ No newline at end of file
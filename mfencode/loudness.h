@@ -0,0 +1,73 @@
+#pragma once
+
+#include "audio.h"
+
+namespace audio
+{
+
+struct LoudnessResult
+{
+    // Integrated loudness, in LUFS.
+    double IntegratedLoudness;
+    // Loudness range, in LU.
+    double LoudnessRange;
+    // Maximum true peak level, in dBTP.
+    double TruePeak;
+};
+
+// Measures loudness according to EBU R128 (ITU-R BS.1770-4 and EBU Tech 3342).
+class LoudnessMeter final : public ISampleProcessor
+{
+public:
+    LoudnessMeter(const AudioFormat &format);
+
+    void ProcessSamples(std::span<const float> samples) override;
+    LoudnessResult GetResult() const;
+
+private:
+    static constexpr size_t c_peakTaps = 12;
+
+    struct Biquad
+    {
+        double B0, B1, B2, A1, A2;
+    };
+
+    // Filter state for two channels, which are processed together in the lanes of one vector.
+    struct ChannelPairState
+    {
+        double Shelf[2][2];
+        double HighPass[2][2];
+        double Energy[2];
+    };
+
+    struct ChannelPeakState
+    {
+        // Each sample is stored twice so the most recent taps are always contiguous.
+        float History[c_peakTaps * 2];
+        size_t Position;
+        float Peak[4];
+    };
+
+    void ProcessEnergy(std::span<const float> samples, size_t frames);
+    void ProcessTruePeak(std::span<const float> samples, size_t frames);
+    void EndSubBlock();
+
+    AudioFormat m_format;
+    Biquad m_shelf;
+    Biquad m_highPass;
+    std::vector<double> m_weights;
+    std::vector<ChannelPairState> m_pairs;
+    std::vector<ChannelPeakState> m_peaks;
+    // Polyphase interpolation filter for 4x oversampling; each element holds one tap of all four
+    // phases.
+    float m_peakCoefficients[c_peakTaps][4];
+    // Mean square energy of each complete 100ms sub-block, already weighted and summed across
+    // channels. Gating blocks and short-term windows are derived from these.
+    std::vector<double> m_subBlocks;
+    size_t m_subBlockFrames;
+    size_t m_subBlockPosition{};
+};
+
+std::wostream &operator<<(std::wostream &stream, const LoudnessResult &result);
+
+}
\ No newline at end of file
@@ -1,11 +1,216 @@
 #include "precomp.h"
 #include "mfutil.h"
+#include "loudness.h"
+#include "peaks.h"
+#include "silence.h"
+#include "progress.h"
+#include "chapters.h"
+#include "async.h"
+#include "outputcache.h"
+#include "resume.h"
+#include "pcmring.h"
 #include "resource.h"
 #include "arguments.h"
 using namespace std;
 using namespace std::chrono_literals;
 
-void EncodeFile(const std::filesystem::path &input, const std::filesystem::path &output, int quality)
+// Maximum true peak of the output when normalizing loudness, as recommended by EBU R128 s1.
+constexpr double c_normalizationMaxTruePeak = -1.0;
+// Size of the ring buffer created by -FeedRing.
+constexpr UINT32 c_feedRingSeconds = 2;
+
+template<typename Session>
+void RunSession(Session &session, std::wstring_view name)
+{
+    session.Start();
+    auto vtSupport = ookii::vt::virtual_terminal_support::enable_color(ookii::standard_stream::output);
+    util::ProgressRenderer renderer{static_cast<bool>(vtSupport)};
+    auto job = renderer.AddJob(std::wstring{name}, session.GetDuration());
+    auto endProgress = wil::scope_exit([&renderer]() { renderer.Finish(); });
+    renderer.Render(true);
+    while (!session.Wait(100ms)) 
+    {
+        renderer.SetProgress(job, session.GetProgress());
+        renderer.Render();
+    }
+
+    renderer.SetCompleted(job);
+}
+
+// Returns true if the encode needs access to the decoded samples, which the transcode API doesn't
+// provide.
+bool RequiresSampleAccess(const Arguments &args)
+{
+    return args.Loudness || args.NormalizeLoudness || !args.Peaks.empty() || args.DetectSilence || args.TrimSilence;
+}
+
+void WriteSilenceStats(const audio::SilenceDetector &detector, const audio::SilenceTrimmingReader *trimmer,
+                       UINT32 samplesPerSecond)
+{
+    auto ranges = detector.GetSilentRanges();
+    wcout << "Silent ranges: " << ranges.size() << endl;
+    for (const auto &range : ranges)
+    {
+        wcout << "  " << util::DurationPrinter{audio::FramesToDuration(range.StartFrame, samplesPerSecond), 3}
+              << " - " << util::DurationPrinter{audio::FramesToDuration(range.EndFrame, samplesPerSecond), 3} << endl;
+    }
+
+    if (trimmer != nullptr)
+    {
+        wcout << "Trimmed leading silence: "
+              << util::DurationPrinter{audio::FramesToDuration(trimmer->GetLeadingFrames(), samplesPerSecond), 3}
+              << "; trailing silence: "
+              << util::DurationPrinter{audio::FramesToDuration(trimmer->GetTrailingFrames(), samplesPerSecond), 3}
+              << "; output duration: "
+              << util::DurationPrinter{audio::FramesToDuration(trimmer->GetOutputFrames(), samplesPerSecond)} << endl;
+    }
+}
+
+// Encodes the input from a PCM cache, after measuring its loudness while filling the cache, so
+// the input only needs to be decoded once. Returns the linear gain that was applied.
+float EncodeNormalized(audio::ISampleReader &reader, const std::filesystem::path &output, int quality,
+                       double targetLoudness, std::span<audio::ISampleProcessor *const> processors)
+{
+    audio::LoudnessMeter meter{reader.GetFormat()};
+    audio::PcmCache cache{reader.GetFormat()};
+    {
+        mf::SampleTranscodeSession analysis{reader, nullptr, quality};
+        analysis.AddProcessor(meter);
+        analysis.AddProcessor(cache);
+        RunSession(analysis, L"Analyzing");
+    }
+
+    auto loudness = meter.GetResult();
+    double gain{};
+    if (std::isfinite(loudness.IntegratedLoudness))
+    {
+        gain = std::min(targetLoudness - loudness.IntegratedLoudness, c_normalizationMaxTruePeak - loudness.TruePeak);
+    }
+
+    auto cachedReader = cache.CreateReader();
+    mf::SampleTranscodeSession session{*cachedReader, output.c_str(), quality};
+    session.SetGain(audio::DecibelsToGain(gain));
+    for (auto processor : processors)
+    {
+        session.AddProcessor(*processor);
+    }
+
+    RunSession(session, L"Encoding");
+    wcout << "Input " << loudness << endl;
+    wcout << "Normalization gain: " << fixed << setprecision(1) << gain << " dB; output integrated loudness: "
+          << (loudness.IntegratedLoudness + gain) << " LUFS" << endl;
+
+    return audio::DecibelsToGain(gain);
+}
+
+// Encodes using the sample pipeline, applying the analysis and processing options. Returns the
+// number of frames trimmed from the start of the input.
+UINT64 EncodeSamples(audio::ISampleReader &sourceReader, const std::filesystem::path &output, const Arguments &args)
+{
+    audio::ISampleReader *reader = &sourceReader;
+    auto format = sourceReader.GetFormat();
+    std::vector<audio::ISampleProcessor *> processors;
+    std::optional<audio::SilenceDetector> silence;
+    std::optional<audio::SilenceTrimmingReader> trimmer;
+    if (args.DetectSilence || args.TrimSilence)
+    {
+        auto minimumDuration = std::chrono::duration_cast<util::WindowsTimeUnits>(
+            std::chrono::duration<float>{args.SilenceDuration});
+
+        silence.emplace(format, args.SilenceThreshold, minimumDuration);
+        if (args.TrimSilence)
+        {
+            reader = &trimmer.emplace(sourceReader, *silence);
+        }
+        else
+        {
+            processors.push_back(&*silence);
+        }
+    }
+
+    std::optional<audio::PeakWriter> peaks;
+    if (!args.Peaks.empty())
+    {
+        processors.push_back(&peaks.emplace(format, args.Peaks));
+    }
+
+    float gain = 1.0f;
+    if (args.NormalizeLoudness)
+    {
+        gain = EncodeNormalized(*reader, output, args.Quality, *args.NormalizeLoudness, processors);
+    }
+    else
+    {
+        std::optional<audio::LoudnessMeter> meter;
+        if (args.Loudness)
+        {
+            processors.push_back(&meter.emplace(format));
+        }
+
+        mf::SampleTranscodeSession session{*reader, output.c_str(), args.Quality};
+        for (auto processor : processors)
+        {
+            session.AddProcessor(*processor);
+        }
+
+        RunSession(session, L"Encoding");
+        if (meter)
+        {
+            wcout << "Loudness: " << meter->GetResult() << endl;
+        }
+    }
+
+    if (silence)
+    {
+        WriteSilenceStats(*silence, trimmer ? &*trimmer : nullptr, format.SamplesPerSecond);
+    }
+
+    if (peaks)
+    {
+        peaks->Save(gain);
+    }
+
+    return trimmer ? trimmer->GetLeadingFrames() : 0;
+}
+
+UINT64 GetMaxCacheSize(const Arguments &args)
+{
+    return static_cast<UINT64>(std::max(args.CacheSize, 0)) * 1024 * 1024;
+}
+
+// Decodes the input to compute its content key, and copies the output from the cache if possible.
+// Otherwise, the input is encoded and the output is added to the cache.
+void EncodeCached(const std::filesystem::path &input, mf::MediaSource &source, const std::filesystem::path &output,
+                  const Arguments &args)
+{
+    util::OutputCache cache{args.Cache, GetMaxCacheSize(args)};
+    std::wstring key;
+    {
+        mf::SourceReaderInput reader{source};
+        util::ContentHasher hasher{reader.GetFormat(), mf::GetAacQualityBytesPerSecond(args.Quality)};
+        mf::SampleTranscodeSession hashing{reader, nullptr, args.Quality};
+        hashing.AddProcessor(hasher);
+        RunSession(hashing, L"Hashing");
+        key = hasher.GetKey();
+    }
+
+    if (cache.TryGet(key, output))
+    {
+        wcout << "Copied from cache: " << key << endl;
+        return;
+    }
+
+    // The source reader has consumed the source, so the input is opened again.
+    mf::MediaSource encodeSource{input.c_str()};
+    mf::TranscodeSession session{encodeSource, output.c_str(), args.Quality};
+    RunSession(session, L"Encoding");
+    if (!cache.Add(key, output))
+    {
+        wcout << "The output could not be added to the cache." << endl;
+    }
+}
+
+void EncodeFile(const std::filesystem::path &input, const std::filesystem::path &output, const Arguments &args)
 {
     mf::MediaSource source{input.c_str()};
     auto attributes = source.GetAttributes();
@@ -15,27 +220,394 @@ void EncodeFile(const std::filesystem::path &input, const std::filesystem::path
           << "; bit depth: " << attributes.BitsPerSample 
           << "; sample rate: " << attributes.SamplesPerSecond
           << "; channels: " << attributes.Channels
-          << "; bitrate: " << ((mf::GetAacQualityBytesPerSecond(quality) * 8) / 1000) << "kbps"
+          << "; bitrate: " << ((mf::GetAacQualityBytesPerSecond(args.Quality) * 8) / 1000) << "kbps"
           << endl;
 
-    mf::TranscodeSession session{source, output.c_str(), quality};
+    if (!args.Cache.empty())
+    {
+        EncodeCached(input, source, output, args);
+        return;
+    }
+
+    if (args.Resumable)
+    {
+        // The output of an interrupted run may exist even if all segments are done, so it only
+        // blocks the encode if there is nothing to resume.
+        mf::ResumableTranscodeSession session{source, input, output, args.Quality};
+        if (!args.Force && !session.IsResuming() && std::filesystem::exists(output))
+        {
+            throw std::runtime_error("The output file already exists. Use -Force to overwrite.");
+        }
+
+        auto resumed = session.GetResumedPosition();
+        if (resumed.count() > 0)
+        {
+            wcout << "Resuming at " << util::DurationPrinter{resumed} << endl;
+        }
+
+        RunSession(session, L"Encoding");
+        return;
+    }
+
+    if (!RequiresSampleAccess(args))
+    {
+        mf::TranscodeSession session{source, output.c_str(), args.Quality};
+        RunSession(session, L"Encoding");
+        return;
+    }
+
+    mf::SourceReaderInput reader{source};
+    EncodeSamples(reader, output, args);
+}
+
+// Decodes the input into a shared memory ring buffer, as a reference producer for -RingInput.
+void FeedRing(const std::filesystem::path &input, const std::wstring &name)
+{
+    mf::MediaSource source{input.c_str()};
+    mf::SourceReaderInput reader{source};
+    auto format = reader.GetFormat();
+    audio::PcmRingWriter writer{name, format, static_cast<UINT64>(format.SamplesPerSecond) * c_feedRingSeconds};
+    wcout << "Feeding ring buffer: " << name << "; sample rate: " << format.SamplesPerSecond << "; channels: "
+          << format.Channels << endl;
+
+    for (auto samples = reader.ReadBlock(); !samples.empty(); samples = reader.ReadBlock())
+    {
+        writer.Write(samples);
+    }
+
+    writer.Finish();
+}
+
+void EncodeRing(const std::wstring &name, const std::filesystem::path &output, const Arguments &args)
+{
+    audio::PcmRingReader reader{name};
+    auto format = reader.GetFormat();
+    wcout << "Input ring buffer: " << name << endl;
+    wcout << "Output: " << output.wstring() << endl;
+    wcout << "Sample rate: " << format.SamplesPerSecond
+          << "; channels: " << format.Channels
+          << "; bitrate: " << ((mf::GetAacQualityBytesPerSecond(args.Quality) * 8) / 1000) << "kbps"
+          << endl;
+
+    EncodeSamples(reader, output, args);
+}
+
+std::vector<std::filesystem::path> ReadInputList(const std::filesystem::path &listFile)
+{
+    std::ifstream file;
+    file.exceptions(std::ios::badbit);
+    file.open(listFile);
+    if (!file)
+    {
+        throw std::runtime_error("The input list could not be opened.");
+    }
+
+    // The list is UTF-8, with one path per line. Relative paths are relative to the list's
+    // directory, and empty lines and lines starting with '#' are ignored.
+    std::vector<std::filesystem::path> result;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (result.empty() && line.starts_with("\xef\xbb\xbf"))
+        {
+            line.erase(0, 3);
+        }
+
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        if (line.empty() || line.front() == '#')
+        {
+            continue;
+        }
+
+        std::filesystem::path path{std::u8string{line.begin(), line.end()}};
+        result.push_back(listFile.parent_path() / path);
+    }
+
+    if (result.empty())
+    {
+        throw std::runtime_error("The input list does not contain any files.");
+    }
+
+    return result;
+}
+
+void ConcatenateFiles(const std::filesystem::path &listFile, const std::filesystem::path &output, const Arguments &args)
+{
+    auto inputs = ReadInputList(listFile);
+    if (inputs.size() > mp4::c_maxChapters)
+    {
+        throw std::runtime_error("The input list contains more than 255 files, which is the most that can each get a chapter.");
+    }
+
+    mf::ConcatenatingReader reader{std::move(inputs)};
+    auto format = reader.GetFormat();
+    wcout << "Inputs: " << reader.GetInputs().size() << endl;
+    wcout << "Output: " << output.wstring() << endl;
+    wcout << "Duration: " << util::DurationPrinter{reader.GetDuration()}
+          << "; sample rate: " << format.SamplesPerSecond
+          << "; channels: " << format.Channels
+          << "; bitrate: " << ((mf::GetAacQualityBytesPerSecond(args.Quality) * 8) / 1000) << "kbps"
+          << endl;
+
+    auto trimmedFrames = EncodeSamples(reader, output, args);
+
+    // Chapter positions need to account for any leading silence that was removed.
+    std::vector<mp4::Chapter> chapters;
+    for (size_t i = 0; i < reader.GetStartFrames().size(); ++i)
+    {
+        auto start = reader.GetStartFrames()[i];
+        start = start > trimmedFrames ? start - trimmedFrames : 0;
+        chapters.push_back({ audio::FramesToDuration(start, format.SamplesPerSecond), reader.GetInputs()[i].stem().wstring() });
+    }
+
+    mp4::WriteChapters(output, chapters);
+}
+
+// State shared by the coroutines of a batch. They all run on the executor's thread, so it needs no
+// synchronization.
+struct BatchState
+{
+    struct Job
+    {
+        std::filesystem::path Input;
+        std::filesystem::path Output;
+        size_t ProgressJob;
+        // Set while a session for the job is running.
+        std::function<float()> GetProgress;
+        std::exception_ptr Error;
+        bool NotCached;
+    };
+
+    std::vector<Job> Jobs;
+    size_t NextJob;
+    size_t Remaining;
+    util::ProgressRenderer &Renderer;
+};
+
+void WriteException(std::exception_ptr exception, bool verbose)
+{
+    try
+    {
+        std::rethrow_exception(exception);
+    }
+    catch (const wil::ResultException &ex)
+    {
+        if (verbose)
+        {
+            wchar_t msg[2048];
+            wil::GetFailureLogString(msg, std::size(msg), ex.GetFailureInfo());
+            util::WriteError(msg);
+        }
+        else
+        {
+            util::WriteError(util::GetSystemErrorMessage(ex.GetErrorCode()));
+        }
+    }
+    catch (const exception &ex)
+    {
+        util::WriteError(ex.what());
+    }
+    catch (...)
+    {
+        util::WriteError(L"Unknown exception.");
+    }
+}
+
+// Runs a session to completion, reporting its progress scaled to the specified part of the job.
+template<typename Session>
+async::Task<> RunBatchSession(async::Executor &executor, BatchState &state, BatchState::Job &job, Session &session,
+                              float progressOffset, float progressScale)
+{
+    co_await executor.Schedule();
+    state.Renderer.SetDuration(job.ProgressJob, session.GetDuration());
     session.Start();
-    float prevProgress{};
-    auto cursorEnable = util::HideCursor();
+    job.GetProgress = [&session, progressOffset, progressScale]() { return progressOffset + session.GetProgress() * progressScale; };
+    auto clearProgress = wil::scope_exit([&job]() { job.GetProgress = nullptr; });
+    co_await session.Completed();
+}
+
+async::Task<> EncodeBatchJob(async::Executor &executor, async::ThreadPool &pool, BatchState &state, BatchState::Job &job,
+                             int quality, util::OutputCache *cache)
+{
+    // Resolving the source and creating the topology block on file I/O, so they are done on the
+    // pool. The pool's threads use the process's multi-threaded apartment.
+    co_await pool.Schedule();
+    std::optional<mf::MediaSource> source{std::in_place, job.Input.c_str()};
+    std::wstring key;
+    float progressOffset = 0.0f;
+    float progressScale = 1.0f;
+    if (cache != nullptr)
+    {
+        {
+            mf::SourceReaderInput reader{*source};
+            util::ContentHasher hasher{reader.GetFormat(), mf::GetAacQualityBytesPerSecond(quality)};
+            mf::SampleTranscodeSession hashing{reader, nullptr, quality};
+            hashing.AddProcessor(hasher);
+            co_await RunBatchSession(executor, state, job, hashing, 0.0f, 0.5f);
+            key = hasher.GetKey();
+        }
+
+        co_await pool.Schedule();
+        if (cache->TryGet(key, job.Output))
+        {
+            co_return;
+        }
+
+        // The source reader has consumed the source, so the input is opened again.
+        source.emplace(job.Input.c_str());
+        progressOffset = progressScale = 0.5f;
+    }
+
+    mf::TranscodeSession session{*source, job.Output.c_str(), quality};
+    co_await RunBatchSession(executor, state, job, session, progressOffset, progressScale);
+    if (cache != nullptr)
+    {
+        co_await pool.Schedule();
+        job.NotCached = !cache->Add(key, job.Output);
+    }
+}
+
+// Takes jobs from the batch until none are left. Several of these run at the same time; while a
+// session is encoding, the executor's thread is free to service the others.
+async::Task<> RunBatchJobs(async::Executor &executor, async::ThreadPool &pool, BatchState &state, int quality,
+                           util::OutputCache *cache)
+{
+    while (state.NextJob < state.Jobs.size())
+    {
+        auto &job = state.Jobs[state.NextJob++];
+        try
+        {
+            co_await EncodeBatchJob(executor, pool, state, job, quality, cache);
+        }
+        catch (...)
+        {
+            job.Error = std::current_exception();
+        }
+
+        // The job may have finished on the pool.
+        co_await executor.Schedule();
+        state.Renderer.SetCompleted(job.ProgressJob);
+        --state.Remaining;
+    }
+}
+
+// Progress is sampled on a timer rather than awaited. The media session raises no events while
+// it's encoding; the position of a TranscodeSession is only known by querying its presentation
+// clock. The renderer also throttles frames to a fixed rate, so a timer is needed either way, and
+// a sample session reporting each block would only add wake-ups that are never drawn.
+async::Task<> ShowBatchProgress(async::Executor &executor, BatchState &state)
+{
+    state.Renderer.Render(true);
+    while (state.Remaining > 0)
+    {
+        co_await executor.Delay(100ms);
+        for (const auto &job : state.Jobs)
+        {
+            if (job.GetProgress)
+            {
+                state.Renderer.SetProgress(job.ProgressJob, job.GetProgress());
+            }
+        }
+
+        state.Renderer.Render();
+    }
+}
+
+// Encodes every file in the list, running several sessions at once from this thread.
+int EncodeBatch(const Arguments &args)
+{
+    if (args.Concatenate || RequiresSampleAccess(args))
+    {
+        throw std::runtime_error("-Batch cannot be combined with -Concatenate or options that need access to the samples.");
+    }
+
+    std::filesystem::path outputDirectory{args.Output};
+    if (!outputDirectory.empty())
+    {
+        std::filesystem::create_directories(outputDirectory);
+    }
+
     auto vtSupport = ookii::vt::virtual_terminal_support::enable_color(ookii::standard_stream::output);
-    auto endProgressBar = wil::scope_exit([]() { wcout << endl; });
-    util::ShowProgress(0.0f, vtSupport);
-    while (!session.Wait(100ms)) 
+    util::ProgressRenderer renderer{static_cast<bool>(vtSupport)};
+    BatchState state{ {}, 0, 0, renderer };
+    // Inputs with the same name in different directories, or with different extensions, would be
+    // encoded to the same output at the same time. Paths are compared like the file system does.
+    std::map<std::wstring, std::filesystem::path> outputInputs;
+    for (auto &input : ReadInputList(args.Input))
+    {
+        auto output = input;
+        output.replace_extension(L".m4a");
+        if (!outputDirectory.empty())
+        {
+            output = outputDirectory / output.filename();
+        }
+
+        auto key = std::filesystem::absolute(output).lexically_normal().wstring();
+        THROW_LAST_ERROR_IF(LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE, key.data(), static_cast<int>(key.size()),
+                                          key.data(), static_cast<int>(key.size()), nullptr, nullptr, 0) == 0);
+
+        auto [existing, inserted] = outputInputs.emplace(std::move(key), input);
+        if (!inserted)
+        {
+            util::WriteError(L"The inputs " + existing->second.wstring() + L" and " + input.wstring() +
+                             L" would both be encoded to " + output.wstring() + L".");
+            return 1;
+        }
+
+        if (!args.Force && std::filesystem::exists(output))
+        {
+            util::WriteError(L"The output file " + output.wstring() + L" already exists. Use -Force to overwrite.");
+            return 1;
+        }
+
+        auto progressJob = renderer.AddJob(input.filename().wstring(), {});
+        state.Jobs.push_back({ std::move(input), std::move(output), progressJob, {}, nullptr, false });
+    }
+
+    state.Remaining = state.Jobs.size();
+    size_t concurrency = args.Jobs > 0 ? args.Jobs : std::max(std::thread::hardware_concurrency(), 1u);
+    concurrency = std::min(concurrency, state.Jobs.size());
+
+    std::optional<util::OutputCache> cache;
+    if (!args.Cache.empty())
+    {
+        cache.emplace(args.Cache, GetMaxCacheSize(args));
+    }
+
+    async::Executor executor;
+    async::ThreadPool pool;
+    for (size_t i = 0; i < concurrency; ++i)
+    {
+        executor.Spawn(RunBatchJobs(executor, pool, state, args.Quality, cache ? &*cache : nullptr));
+    }
+
+    executor.Spawn(ShowBatchProgress(executor, state));
+    {
+        auto endProgress = wil::scope_exit([&renderer]() { renderer.Finish(); });
+        executor.Run();
+    }
+
+    size_t failed = 0;
+    for (const auto &job : state.Jobs)
     {
-        auto progress = session.GetProgress();
-        if (progress > prevProgress)
+        if (job.Error)
         {
-            util::ShowProgress(progress, vtSupport);
-            prevProgress = progress;
+            ++failed;
+            wcout << "Failed: " << job.Input.wstring() << endl;
+            WriteException(job.Error, args.Verbose);
+        }
+        else if (job.NotCached)
+        {
+            wcout << "Not added to the cache: " << job.Input.wstring() << endl;
         }
     }
 
-    util::ShowProgress(1.0f, vtSupport);
+    wcout << "Encoded " << (state.Jobs.size() - failed) << " of " << state.Jobs.size() << " files." << endl;
+    return failed == 0 ? 0 : 1;
 }
 
 // Invoked by the main() function generated by Ookii.CommandLine.
@@ -46,6 +618,32 @@ int mfencode_main(Arguments args)
         auto com = wil::CoInitializeEx();
         auto mf = mf::Startup();
 
+        if (!args.Cache.empty() && (args.Concatenate || RequiresSampleAccess(args)))
+        {
+            throw std::runtime_error("-Cache cannot be combined with -Concatenate or options that need access to the samples.");
+        }
+
+        if (args.Resumable && (args.Batch || !args.Cache.empty() || args.Concatenate || RequiresSampleAccess(args)))
+        {
+            throw std::runtime_error("-Resumable cannot be combined with -Batch, -Cache, -Concatenate or options that need access to the samples.");
+        }
+
+        if (args.RingInput && (args.Output.empty() || args.Batch || !args.Cache.empty() || args.Concatenate || args.Resumable))
+        {
+            throw std::runtime_error("-RingInput requires an output path, and cannot be combined with -Batch, -Cache, -Concatenate or -Resumable.");
+        }
+
+        if (!args.FeedRing.empty())
+        {
+            FeedRing(args.Input, args.FeedRing);
+            return 0;
+        }
+
+        if (args.Batch)
+        {
+            return EncodeBatch(args);
+        }
+
         std::filesystem::path output{args.Output};
         if (output.empty())
         {
@@ -53,35 +651,37 @@ int mfencode_main(Arguments args)
             output.replace_extension(L".m4a");
         }
 
-        if (!args.Force && std::filesystem::exists(output))
+        // A resumable encode checks this itself, once it knows whether there is a checkpoint.
+        if (!args.Force && !args.Resumable && std::filesystem::exists(output))
         {
             util::WriteError("The output file already exists. Use -Force to overwrite.");
             return 1;
         }
 
-        EncodeFile(args.Input, output, args.Quality);
-        return 0;
-    }
-    catch (const wil::ResultException &ex)
-    {
-        if (args.Verbose)
+        if (!args.Force && !args.Peaks.empty() && std::filesystem::exists(args.Peaks))
         {
-            wchar_t msg[2048];
-            wil::GetFailureLogString(msg, std::size(msg), ex.GetFailureInfo());
-            util::WriteError(msg);
+            util::WriteError("The peaks file already exists. Use -Force to overwrite.");
+            return 1;
+        }
+
+        if (args.RingInput)
+        {
+            EncodeRing(args.Input, output, args);
+        }
+        else if (args.Concatenate)
+        {
+            ConcatenateFiles(args.Input, output, args);
         }
         else
         {
-            util::WriteError(util::GetSystemErrorMessage(ex.GetErrorCode()));
+            EncodeFile(args.Input, output, args);
         }
-    }
-    catch (const exception &ex)
-    {
-        util::WriteError(ex.what());
+
+        return 0;
     }
     catch (...)
     {
-        util::WriteError(L"Unknown exception.");
+        WriteException(std::current_exception(), args.Verbose);
     }
 
     return 1;
@@ -10,6 +10,8 @@ constexpr UINT32 c_aacProfileL4 = 0x2a; // Max 5 channels, 48kHz
 constexpr UINT32 c_aacProfileL5 = 0x2b; // Max 5 channels, 96kHz
 
 constexpr UINT32 c_aacQualityBytesPerSecond[] = { 12000, 16000, 20000, 24000 };
+// How far before the requested position SourceReaderInput::Seek positions the reader.
+constexpr util::WindowsTimeUnits c_seekMargin = std::chrono::seconds{1};
 
 wil::com_ptr<IMFSourceResolver> CreateSourceResolver()
 {
@@ -46,6 +48,13 @@ wil::com_ptr<IMFMediaSession> CreateMediaSession(IMFAttributes *configuration)
     return session;
 }
 
+wil::com_ptr<IMFMediaType> CreateMediaType()
+{
+    wil::com_ptr<IMFMediaType> type;
+    THROW_IF_FAILED(MFCreateMediaType(&type));
+    return type;
+}
+
 wil::com_ptr<IMFTranscodeProfile> CreateAacTranscodeProfile(UINT32 bitsPerSample, UINT32 samplesPerSecond, UINT32 channels, UINT32 avgBytesPerSecond)
 {
     auto profile = CreateTranscodeProfile();
@@ -80,6 +89,16 @@ UINT32 GetAacQualityBytesPerSecond(int quality)
     return c_aacQualityBytesPerSecond[quality - 1];
 }
 
+float CalculateProgress(util::WindowsTimeUnits position, util::WindowsTimeUnits duration)
+{
+    if (duration.count() == 0)
+    {
+        return {};
+    }
+
+    return static_cast<float>(position.count()) / duration.count();
+}
+
 [[nodiscard]] unique_mfshutdown_call Startup()
 {
     THROW_IF_FAILED(MFStartup(MF_VERSION));
@@ -95,6 +114,13 @@ MediaSource::MediaSource(PCWSTR input)
     m_source = source.query<IMFMediaSource>();
 }
 
+MediaSource::~MediaSource()
+{
+    // The source is not shut down by the sessions and readers that use it, and keeps the file
+    // open until it is.
+    m_source->Shutdown();
+}
+
 MediaAttributes MediaSource::GetAttributes() const
 {
     MediaAttributes result;
@@ -144,6 +170,12 @@ TranscodeSession::TranscodeSession(MediaSource &source, PCWSTR output, int quali
     m_duration = sourceAttributes.Duration;
 }
 
+TranscodeSession::~TranscodeSession()
+{
+    // The session is normally shut down once it's closed; this covers sessions that never ran.
+    m_session->Shutdown();
+}
+
 void TranscodeSession::Start()
 {
     m_eventSink->BeginGetEvent();
@@ -166,6 +198,11 @@ bool TranscodeSession::Wait(std::chrono::milliseconds timeout)
     return false;
 }
 
+async::CompletionEvent &TranscodeSession::Completed()
+{
+    return m_completed;
+}
+
 util::WindowsTimeUnits TranscodeSession::GetPosition() const
 {
     MFTIME time;
@@ -178,18 +215,24 @@ util::WindowsTimeUnits TranscodeSession::GetPosition() const
         return {};
     }
 
+    // The clock is shut down with the session once it is closed.
+    if (result == MF_E_SHUTDOWN)
+    {
+        return m_duration;
+    }
+
     THROW_IF_FAILED(result);
     return util::WindowsTimeUnits{time};
 }
 
-float TranscodeSession::GetProgress() const
+util::WindowsTimeUnits TranscodeSession::GetDuration() const
 {
-    if (m_duration.count() == 0)
-    {
-        return {};
-    }
+    return m_duration;
+}
 
-    return static_cast<float>(GetPosition().count()) / m_duration.count();
+float TranscodeSession::GetProgress() const
+{
+    return CalculateProgress(GetPosition(), m_duration);
 }
 
 void TranscodeSession::OnSessionEnded()
@@ -199,14 +242,20 @@ void TranscodeSession::OnSessionEnded()
 
 void TranscodeSession::OnSessionClosed()
 {
+    // Without this, the session's resources are never released, which adds up with -Batch.
+    m_session->Shutdown();
     m_waitEvent.SetEvent();
+    m_completed.SetCompleted(m_exception);
 }
 
 void TranscodeSession::OnError(std::exception_ptr exception)
 {
     m_exception = exception;
-    m_session->Close();
+    // No more events are requested after an error, so the session is shut down without waiting
+    // for it to close.
+    m_session->Shutdown();
     m_waitEvent.SetEvent();
+    m_completed.SetCompleted(exception);
 }
 
 IMFMediaSession *TranscodeSession::GetMediaSession()
@@ -219,6 +268,414 @@ IMFTopology *TranscodeSession::GetTopology()
     return m_topology.get();
 }
 
+SourceReaderInput::SourceReaderInput(MediaSource &source, const std::optional<audio::AudioFormat> &format)
+    : m_duration{source.GetAttributes().Duration}
+{
+    // Keep the media source alive after the reader is released, since it's owned by MediaSource.
+    auto attributes = CreateAttributes(1);
+    AttributeHelper{attributes}.Set(MF_SOURCE_READER_DISCONNECT_MEDIASOURCE_ON_SHUTDOWN, TRUE);
+    THROW_IF_FAILED(MFCreateSourceReaderFromMediaSource(source.Get(), attributes.get(), &m_reader));
+    THROW_IF_FAILED(m_reader->SetStreamSelection(static_cast<DWORD>(MF_SOURCE_READER_ALL_STREAMS), FALSE));
+    THROW_IF_FAILED(m_reader->SetStreamSelection(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), TRUE));
+
+    // If no format is specified, the reader keeps the native rate and channel count. Otherwise,
+    // it inserts a resampler to convert to the requested format.
+    auto type = CreateMediaType();
+    AttributeHelper helper{type.get()};
+    helper.Set(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+    helper.Set(MF_MT_SUBTYPE, MFAudioFormat_Float);
+    if (format)
+    {
+        helper.Set(MF_MT_AUDIO_BITS_PER_SAMPLE, 32);
+        helper.Set(MF_MT_AUDIO_SAMPLES_PER_SECOND, format->SamplesPerSecond);
+        helper.Set(MF_MT_AUDIO_NUM_CHANNELS, format->Channels);
+        helper.Set(MF_MT_AUDIO_BLOCK_ALIGNMENT, format->GetFrameSize());
+        helper.Set(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, format->SamplesPerSecond * format->GetFrameSize());
+    }
+
+    THROW_IF_FAILED(m_reader->SetCurrentMediaType(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), nullptr,
+                                                  type.get()));
+
+    m_format = GetCurrentFormat();
+}
+
+SourceReaderInput::~SourceReaderInput()
+{
+    UnlockBuffer();
+}
+
+std::span<const float> SourceReaderInput::ReadBlock()
+{
+    UnlockBuffer();
+    for (;;)
+    {
+        DWORD flags;
+        LONGLONG timestamp;
+        wil::com_ptr<IMFSample> sample;
+        THROW_IF_FAILED(m_reader->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), 0, nullptr, &flags,
+                                             &timestamp, &sample));
+
+        if (flags & MF_SOURCE_READERF_ENDOFSTREAM)
+        {
+            return {};
+        }
+
+        // Some inputs change format partway through, such as MP3 files that switch sample rate, or
+        // AAC with SBR or PS signaled later in the stream. The consumers of the samples were set up
+        // for the original format, so they would misinterpret the samples that follow.
+        if ((flags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED) && GetCurrentFormat() != m_format)
+        {
+            throw std::runtime_error("The sample rate or channel count of the input changed while decoding, which is not supported.");
+        }
+
+        // Stream ticks and other events can produce calls without a sample.
+        if (!sample)
+        {
+            continue;
+        }
+
+        wil::com_ptr<IMFMediaBuffer> buffer;
+        THROW_IF_FAILED(sample->ConvertToContiguousBuffer(&buffer));
+        BYTE *data;
+        DWORD length;
+        THROW_IF_FAILED(buffer->Lock(&data, nullptr, &length));
+        m_lockedBuffer = std::move(buffer);
+        std::span<const float> samples{ reinterpret_cast<const float *>(data), length / sizeof(float) };
+        if (!m_seekFrame)
+        {
+            return samples;
+        }
+
+        // After a seek, discard samples before the requested frame, using the timestamps.
+        auto firstFrame = static_cast<UINT64>(
+            (timestamp * m_format.SamplesPerSecond + wil::filetime_duration::one_second / 2) / wil::filetime_duration::one_second);
+
+        auto frames = samples.size() / m_format.Channels;
+        if (firstFrame > *m_seekFrame)
+        {
+            throw std::runtime_error("The input could not be seeked to the requested position.");
+        }
+
+        if (firstFrame + frames <= *m_seekFrame)
+        {
+            UnlockBuffer();
+            continue;
+        }
+
+        auto skip = *m_seekFrame - firstFrame;
+        m_seekFrame.reset();
+        return samples.subspan(static_cast<size_t>(skip * m_format.Channels));
+    }
+}
+
+void SourceReaderInput::Seek(UINT64 frame)
+{
+    // Decoders don't necessarily seek to the exact position, so seek to somewhat earlier and let
+    // ReadBlock discard the samples in between.
+    UnlockBuffer();
+    auto target = audio::FramesToDuration(frame, m_format.SamplesPerSecond);
+    auto position = std::max(target - c_seekMargin, util::WindowsTimeUnits{});
+    wil::unique_prop_variant value;
+    value.vt = VT_I8;
+    value.hVal.QuadPart = position.count();
+    THROW_IF_FAILED(m_reader->SetCurrentPosition(GUID_NULL, value));
+    m_seekFrame = frame;
+}
+
+audio::AudioFormat SourceReaderInput::GetFormat() const
+{
+    return m_format;
+}
+
+util::WindowsTimeUnits SourceReaderInput::GetDuration() const
+{
+    return m_duration;
+}
+
+audio::AudioFormat SourceReaderInput::GetCurrentFormat() const
+{
+    wil::com_ptr<IMFMediaType> currentType;
+    THROW_IF_FAILED(m_reader->GetCurrentMediaType(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), &currentType));
+    AttributeHelper helper{currentType.get()};
+    audio::AudioFormat format{};
+    format.SamplesPerSecond = helper.GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND);
+    format.Channels = helper.GetUINT32(MF_MT_AUDIO_NUM_CHANNELS);
+    return format;
+}
+
+void SourceReaderInput::UnlockBuffer()
+{
+    if (m_lockedBuffer)
+    {
+        m_lockedBuffer->Unlock();
+        m_lockedBuffer.reset();
+    }
+}
+
+ConcatenatingReader::ConcatenatingReader(std::vector<std::filesystem::path> inputs)
+    : m_inputs{std::move(inputs)}
+{
+    // Open every input up front, so a missing file is reported before encoding starts and the
+    // total duration is known.
+    for (const auto &input : m_inputs)
+    {
+        auto attributes = MediaSource{input.c_str()}.GetAttributes();
+        if (m_format.Channels == 0)
+        {
+            m_format.SamplesPerSecond = attributes.SamplesPerSecond;
+            m_format.Channels = attributes.Channels;
+        }
+
+        m_duration += attributes.Duration;
+    }
+}
+
+std::span<const float> ConcatenatingReader::ReadBlock()
+{
+    for (;;)
+    {
+        if (m_reader)
+        {
+            auto samples = m_reader->ReadBlock();
+            if (!samples.empty())
+            {
+                m_frames += samples.size() / m_format.Channels;
+                return samples;
+            }
+
+            m_reader.reset();
+            m_source.reset();
+        }
+
+        if (m_nextInput == m_inputs.size())
+        {
+            return {};
+        }
+
+        // Every input is converted to the format of the first one.
+        m_source.emplace(m_inputs[m_nextInput].c_str());
+        m_reader.emplace(*m_source, m_format);
+        m_startFrames.push_back(m_frames);
+        ++m_nextInput;
+    }
+}
+
+audio::AudioFormat ConcatenatingReader::GetFormat() const
+{
+    return m_format;
+}
+
+util::WindowsTimeUnits ConcatenatingReader::GetDuration() const
+{
+    return m_duration;
+}
+
+const std::vector<std::filesystem::path> &ConcatenatingReader::GetInputs() const
+{
+    return m_inputs;
+}
+
+const std::vector<UINT64> &ConcatenatingReader::GetStartFrames() const
+{
+    return m_startFrames;
+}
+
+AacSinkWriter::AacSinkWriter(PCWSTR output, const audio::AudioFormat &format, UINT32 avgBytesPerSecond)
+    : m_format{format}
+{
+    auto attributes = CreateAttributes(1);
+    AttributeHelper{attributes}.Set(MF_TRANSCODE_CONTAINERTYPE, MFTranscodeContainerType_MPEG4);
+    THROW_IF_FAILED(MFCreateSinkWriterFromURL(output, nullptr, attributes.get(), &m_writer));
+
+    auto outputType = CreateMediaType();
+    AttributeHelper outputHelper{outputType.get()};
+    outputHelper.Set(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+    outputHelper.Set(MF_MT_SUBTYPE, MFAudioFormat_AAC);
+    outputHelper.Set(MF_MT_AUDIO_BITS_PER_SAMPLE, 16);
+    outputHelper.Set(MF_MT_AUDIO_SAMPLES_PER_SECOND, format.SamplesPerSecond);
+    outputHelper.Set(MF_MT_AUDIO_NUM_CHANNELS, format.Channels);
+    outputHelper.Set(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, avgBytesPerSecond);
+    outputHelper.Set(MF_MT_AAC_AUDIO_PROFILE_LEVEL_INDICATION, c_aacProfileL2);
+    THROW_IF_FAILED(m_writer->AddStream(outputType.get(), &m_streamIndex));
+
+    // The AAC encoder only accepts 16-bit PCM; the conversion from float is done in Write.
+    auto inputType = CreateMediaType();
+    AttributeHelper inputHelper{inputType.get()};
+    inputHelper.Set(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+    inputHelper.Set(MF_MT_SUBTYPE, MFAudioFormat_PCM);
+    inputHelper.Set(MF_MT_AUDIO_BITS_PER_SAMPLE, 16);
+    inputHelper.Set(MF_MT_AUDIO_SAMPLES_PER_SECOND, format.SamplesPerSecond);
+    inputHelper.Set(MF_MT_AUDIO_NUM_CHANNELS, format.Channels);
+    inputHelper.Set(MF_MT_AUDIO_BLOCK_ALIGNMENT, format.Channels * 2);
+    inputHelper.Set(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, format.SamplesPerSecond * format.Channels * 2);
+    THROW_IF_FAILED(m_writer->SetInputMediaType(m_streamIndex, inputType.get(), nullptr));
+    THROW_IF_FAILED(m_writer->BeginWriting());
+}
+
+void AacSinkWriter::Write(std::span<const float> samples, float gain)
+{
+    if (samples.empty())
+    {
+        return;
+    }
+
+    auto size = static_cast<DWORD>(samples.size() * sizeof(int16_t));
+    wil::com_ptr<IMFMediaBuffer> buffer;
+    THROW_IF_FAILED(MFCreateMemoryBuffer(size, &buffer));
+    BYTE *data;
+    THROW_IF_FAILED(buffer->Lock(&data, nullptr, nullptr));
+    {
+        auto unlock = wil::scope_exit([&buffer]() { buffer->Unlock(); });
+        audio::ConvertToInt16(samples, reinterpret_cast<int16_t *>(data), gain);
+    }
+
+    THROW_IF_FAILED(buffer->SetCurrentLength(size));
+
+    wil::com_ptr<IMFSample> sample;
+    THROW_IF_FAILED(MFCreateSample(&sample));
+    THROW_IF_FAILED(sample->AddBuffer(buffer.get()));
+    auto frames = samples.size() / m_format.Channels;
+    auto start = audio::FramesToDuration(m_frames, m_format.SamplesPerSecond);
+    auto end = audio::FramesToDuration(m_frames + frames, m_format.SamplesPerSecond);
+    THROW_IF_FAILED(sample->SetSampleTime(start.count()));
+    THROW_IF_FAILED(sample->SetSampleDuration((end - start).count()));
+    THROW_IF_FAILED(m_writer->WriteSample(m_streamIndex, sample.get()));
+    m_frames += frames;
+}
+
+void AacSinkWriter::Finalize()
+{
+    THROW_IF_FAILED(m_writer->Finalize());
+}
+
+SessionWorker::SessionWorker()
+{
+    m_waitEvent.create(wil::EventOptions::ManualReset);
+}
+
+void SessionWorker::Start(std::function<void(std::stop_token)> work)
+{
+    m_thread = std::jthread{[this, work = std::move(work)](std::stop_token stopToken) { Run(work, stopToken); }};
+}
+
+bool SessionWorker::Wait(std::chrono::milliseconds timeout)
+{
+    if (m_waitEvent.wait(static_cast<DWORD>(timeout.count())))
+    {
+        if (m_exception)
+        {
+            std::rethrow_exception(m_exception);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+async::CompletionEvent &SessionWorker::Completed()
+{
+    return m_completed;
+}
+
+void SessionWorker::Run(const std::function<void(std::stop_token)> &work, std::stop_token stopToken)
+{
+    auto setEvent = wil::scope_exit([this]()
+    {
+        m_waitEvent.SetEvent();
+        m_completed.SetCompleted(m_exception);
+    });
+
+    try
+    {
+        auto com = wil::CoInitializeEx();
+        work(stopToken);
+    }
+    catch (...)
+    {
+        m_exception = std::current_exception();
+    }
+}
+
+SampleTranscodeSession::SampleTranscodeSession(audio::ISampleReader &reader, PCWSTR output, int quality)
+    : m_reader{reader},
+      m_duration{reader.GetDuration()}
+{
+    if (output != nullptr)
+    {
+        m_writer.emplace(output, reader.GetFormat(), GetAacQualityBytesPerSecond(quality));
+    }
+}
+
+void SampleTranscodeSession::AddProcessor(audio::ISampleProcessor &processor)
+{
+    m_processors.push_back(&processor);
+}
+
+void SampleTranscodeSession::SetGain(float gain)
+{
+    m_gain = gain;
+}
+
+void SampleTranscodeSession::Start()
+{
+    m_worker.Start([this](std::stop_token stopToken) { Run(stopToken); });
+}
+
+bool SampleTranscodeSession::Wait(std::chrono::milliseconds timeout)
+{
+    return m_worker.Wait(timeout);
+}
+
+async::CompletionEvent &SampleTranscodeSession::Completed()
+{
+    return m_worker.Completed();
+}
+
+util::WindowsTimeUnits SampleTranscodeSession::GetPosition() const
+{
+    return audio::FramesToDuration(m_frames, m_reader.GetFormat().SamplesPerSecond);
+}
+
+util::WindowsTimeUnits SampleTranscodeSession::GetDuration() const
+{
+    return m_duration;
+}
+
+float SampleTranscodeSession::GetProgress() const
+{
+    return CalculateProgress(GetPosition(), m_duration);
+}
+
+void SampleTranscodeSession::Run(std::stop_token stopToken)
+{
+    auto channels = m_reader.GetFormat().Channels;
+    for (auto samples = m_reader.ReadBlock(); !samples.empty(); samples = m_reader.ReadBlock())
+    {
+        if (stopToken.stop_requested())
+        {
+            return;
+        }
+
+        for (auto processor : m_processors)
+        {
+            processor->ProcessSamples(samples);
+        }
+
+        if (m_writer)
+        {
+            m_writer->Write(samples, m_gain);
+        }
+
+        m_frames += samples.size() / channels;
+    }
+
+    if (m_writer)
+    {
+        m_writer->Finalize();
+    }
+}
+
 AttributeHelper::AttributeHelper(IMFAttributes *attributes)
     : m_attributes{attributes}
 {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "util.h"
+#include "audio.h"
+#include "async.h"
 
 namespace mf
 {
@@ -21,7 +23,11 @@ class MediaSource
 {
 public:
     MediaSource(PCWSTR input);
-    
+    ~MediaSource();
+
+    MediaSource(const MediaSource &) = delete;
+    MediaSource &operator=(const MediaSource &) = delete;
+
     MediaAttributes GetAttributes() const;
     IMFMediaSource *Get();
 
@@ -62,10 +68,14 @@ class TranscodeSession final : private ISessionEvents
 {
 public:
     TranscodeSession(MediaSource &source, PCWSTR output, int quality);
+    ~TranscodeSession();
 
     void Start();
     bool Wait(std::chrono::milliseconds timeout);
+    // Returns an event that can be awaited by a coroutine instead of calling Wait.
+    async::CompletionEvent &Completed();
     util::WindowsTimeUnits GetPosition() const;
+    util::WindowsTimeUnits GetDuration() const;
     float GetProgress() const;
 
 private:
@@ -80,10 +90,128 @@ private:
     wil::com_ptr<SessionEventSink> m_eventSink;
     wil::com_ptr<IMFPresentationClock> m_clock;
     wil::unique_event m_waitEvent;
+    async::CompletionEvent m_completed;
     std::exception_ptr m_exception;
     util::WindowsTimeUnits m_duration{};
 };
 
+// Decodes the first audio stream of a media source to interleaved float samples.
+class SourceReaderInput final : public audio::ISampleReader
+{
+public:
+    SourceReaderInput(MediaSource &source, const std::optional<audio::AudioFormat> &format = std::nullopt);
+    ~SourceReaderInput();
+
+    std::span<const float> ReadBlock() override;
+    audio::AudioFormat GetFormat() const override;
+    util::WindowsTimeUnits GetDuration() const override;
+
+    // Seeks so the next block starts exactly at the specified frame.
+    void Seek(UINT64 frame);
+
+private:
+    audio::AudioFormat GetCurrentFormat() const;
+    void UnlockBuffer();
+
+    wil::com_ptr<IMFSourceReader> m_reader;
+    wil::com_ptr<IMFMediaBuffer> m_lockedBuffer;
+    audio::AudioFormat m_format{};
+    util::WindowsTimeUnits m_duration{};
+    std::optional<UINT64> m_seekFrame;
+};
+
+// Reads several inputs one after the other, as if they were a single stream.
+class ConcatenatingReader final : public audio::ISampleReader
+{
+public:
+    ConcatenatingReader(std::vector<std::filesystem::path> inputs);
+
+    std::span<const float> ReadBlock() override;
+    audio::AudioFormat GetFormat() const override;
+    util::WindowsTimeUnits GetDuration() const override;
+
+    const std::vector<std::filesystem::path> &GetInputs() const;
+    // Returns the frame at which each input that has been read so far started.
+    const std::vector<UINT64> &GetStartFrames() const;
+
+private:
+    std::vector<std::filesystem::path> m_inputs;
+    size_t m_nextInput{};
+    std::vector<UINT64> m_startFrames;
+    UINT64 m_frames{};
+    audio::AudioFormat m_format{};
+    util::WindowsTimeUnits m_duration{};
+    // The reader must be destroyed before the source.
+    std::optional<MediaSource> m_source;
+    std::optional<SourceReaderInput> m_reader;
+};
+
+// Encodes float samples to AAC in an MPEG-4 container.
+class AacSinkWriter
+{
+public:
+    AacSinkWriter(PCWSTR output, const audio::AudioFormat &format, UINT32 avgBytesPerSecond);
+
+    void Write(std::span<const float> samples, float gain);
+    void Finalize();
+
+private:
+    wil::com_ptr<IMFSinkWriter> m_writer;
+    DWORD m_streamIndex{};
+    audio::AudioFormat m_format;
+    UINT64 m_frames{};
+};
+
+// Runs the work of a session on a worker thread with COM initialized, and reports its completion
+// through Wait and Completed. Declare it as the last member of the session, so the thread is
+// joined before the members the work uses are destroyed.
+class SessionWorker
+{
+public:
+    SessionWorker();
+
+    void Start(std::function<void(std::stop_token)> work);
+    bool Wait(std::chrono::milliseconds timeout);
+    async::CompletionEvent &Completed();
+
+private:
+    void Run(const std::function<void(std::stop_token)> &work, std::stop_token stopToken);
+
+    wil::unique_event m_waitEvent;
+    async::CompletionEvent m_completed;
+    std::exception_ptr m_exception;
+    std::jthread m_thread;
+};
+
+// Transcodes by pulling samples from a reader on a worker thread, so they can be analyzed and
+// modified before they are encoded. If output is nullptr, the samples are only passed to the
+// processors.
+class SampleTranscodeSession final
+{
+public:
+    SampleTranscodeSession(audio::ISampleReader &reader, PCWSTR output, int quality);
+
+    void AddProcessor(audio::ISampleProcessor &processor);
+    void SetGain(float gain);
+    void Start();
+    bool Wait(std::chrono::milliseconds timeout);
+    async::CompletionEvent &Completed();
+    util::WindowsTimeUnits GetPosition() const;
+    util::WindowsTimeUnits GetDuration() const;
+    float GetProgress() const;
+
+private:
+    void Run(std::stop_token stopToken);
+
+    audio::ISampleReader &m_reader;
+    std::optional<AacSinkWriter> m_writer;
+    std::vector<audio::ISampleProcessor *> m_processors;
+    float m_gain{1.0f};
+    std::atomic<UINT64> m_frames{};
+    util::WindowsTimeUnits m_duration{};
+    SessionWorker m_worker;
+};
+
 class AttributeHelper
 {
 public:
@@ -105,9 +233,11 @@ wil::com_ptr<IMFTranscodeProfile> CreateTranscodeProfile();
 wil::com_ptr<IMFAttributes> CreateAttributes(UINT32 initialSize);
 wil::com_ptr<IMFTopology> CreateTopology(IMFMediaSource *source, PCWSTR output, IMFTranscodeProfile *profile);
 wil::com_ptr<IMFMediaSession> CreateMediaSession(IMFAttributes *configuration = nullptr);
+wil::com_ptr<IMFMediaType> CreateMediaType();
 wil::com_ptr<IMFTranscodeProfile> CreateAacTranscodeProfile(UINT32 bitsPerSample, UINT32 samplesPerSecond, UINT32 channel,
                                                     UINT32 avgBytesPerSecond);
 
 UINT32 GetAacQualityBytesPerSecond(int quality);
+float CalculateProgress(util::WindowsTimeUnits position, util::WindowsTimeUnits duration);
 
 }
\ No newline at end of file
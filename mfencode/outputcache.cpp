@@ -0,0 +1,192 @@
+#include "precomp.h"
+#include "outputcache.h"
+
+namespace util
+{
+
+// Changing the encoder in a way that affects its output should change this, so old entries are
+// not used.
+constexpr char c_cacheKeyVersion[] = "mfencode-cache-1";
+constexpr wchar_t c_cacheEntryExtension[] = L".m4a";
+constexpr wchar_t c_cacheTempExtension[] = L".tmp";
+// Temporary files older than this were left behind by a process that was terminated while adding
+// an entry.
+constexpr std::chrono::hours c_staleTempAge{1};
+
+ContentHasher::ContentHasher(const audio::AudioFormat &format, UINT32 avgBytesPerSecond)
+{
+    THROW_IF_NTSTATUS_FAILED(BCryptCreateHash(BCRYPT_SHA256_ALG_HANDLE, &m_hash, nullptr, 0, nullptr, 0, 0));
+    HashData(c_cacheKeyVersion, sizeof(c_cacheKeyVersion));
+    HashData(&format.SamplesPerSecond, sizeof(format.SamplesPerSecond));
+    HashData(&format.Channels, sizeof(format.Channels));
+    HashData(&avgBytesPerSecond, sizeof(avgBytesPerSecond));
+}
+
+void ContentHasher::ProcessSamples(std::span<const float> samples)
+{
+    HashData(samples.data(), samples.size_bytes());
+}
+
+std::wstring ContentHasher::GetKey()
+{
+    BYTE hash[32];
+    THROW_IF_NTSTATUS_FAILED(BCryptFinishHash(m_hash.get(), hash, sizeof(hash), 0));
+    std::wostringstream result;
+    result << std::hex << std::setfill(L'0');
+    for (auto value : hash)
+    {
+        result << std::setw(2) << static_cast<int>(value);
+    }
+
+    return result.str();
+}
+
+void ContentHasher::HashData(const void *data, size_t size)
+{
+    auto bytes = static_cast<const BYTE *>(data);
+    while (size > 0)
+    {
+        auto count = static_cast<ULONG>(std::min<size_t>(size, MAXULONG));
+        THROW_IF_NTSTATUS_FAILED(BCryptHashData(m_hash.get(), const_cast<BYTE *>(bytes), count, 0));
+        bytes += count;
+        size -= count;
+    }
+}
+
+OutputCache::OutputCache(std::filesystem::path directory, UINT64 maxSize)
+    : m_directory{std::move(directory)},
+      m_maxSize{maxSize}
+{
+    std::filesystem::create_directories(m_directory);
+}
+
+bool OutputCache::TryGet(std::wstring_view key, const std::filesystem::path &output)
+{
+    auto entry = GetEntryPath(key);
+    if (!CopyFileW(entry.c_str(), output.c_str(), FALSE))
+    {
+        auto error = GetLastError();
+        if (error == ERROR_FILE_NOT_FOUND)
+        {
+            return false;
+        }
+
+        THROW_WIN32(error);
+    }
+
+    // The modification time of an entry is its last use, for eviction. Failure is not fatal; the
+    // entry may have been evicted by another process in the meantime.
+    std::error_code error;
+    std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), error);
+    return true;
+}
+
+bool OutputCache::Add(std::wstring_view key, const std::filesystem::path &output)
+{
+    // Copy to a unique temporary name first, and rename it, so nobody sees a partial entry.
+    auto entry = GetEntryPath(key);
+    auto temp = entry;
+    temp += L"." + std::to_wstring(GetCurrentProcessId()) + L"." + std::to_wstring(GetCurrentThreadId()) + c_cacheTempExtension;
+    bool added = false;
+    try
+    {
+        THROW_IF_WIN32_BOOL_FALSE(CopyFileW(output.c_str(), temp.c_str(), FALSE));
+        std::filesystem::last_write_time(temp, std::filesystem::file_time_type::clock::now());
+        // This fails if another process has the entry open, e.g. because it added the same
+        // entry and is copying it out.
+        std::filesystem::rename(temp, entry);
+        added = true;
+    }
+    catch (...)
+    {
+        std::error_code error;
+        std::filesystem::remove(temp, error);
+    }
+
+    try
+    {
+        Evict();
+    }
+    catch (...)
+    {
+        // Eviction is retried on the next add.
+    }
+
+    return added;
+}
+
+std::filesystem::path OutputCache::GetEntryPath(std::wstring_view key) const
+{
+    auto result = m_directory / key;
+    result += c_cacheEntryExtension;
+    return result;
+}
+
+void OutputCache::Evict()
+{
+    struct Entry
+    {
+        std::filesystem::path Path;
+        std::filesystem::file_time_type LastUsed;
+        UINT64 Size;
+    };
+
+    std::lock_guard lock{m_mutex};
+    std::vector<Entry> entries;
+    UINT64 totalSize{};
+    auto now = std::filesystem::file_time_type::clock::now();
+    for (const auto &item : std::filesystem::directory_iterator{m_directory})
+    {
+        std::error_code error;
+        auto extension = item.path().extension();
+        if ((extension != c_cacheEntryExtension && extension != c_cacheTempExtension) || !item.is_regular_file(error))
+        {
+            continue;
+        }
+
+        auto size = item.file_size(error);
+        auto lastUsed = item.last_write_time(error);
+        if (error)
+        {
+            continue;
+        }
+
+        if (extension == c_cacheTempExtension)
+        {
+            // Temporary files that are still being written will soon be entries, so they count
+            // towards the size. Stale ones are removed; that fails if one is still in use.
+            if (now - lastUsed < c_staleTempAge || !std::filesystem::remove(item.path(), error))
+            {
+                totalSize += size;
+            }
+
+            continue;
+        }
+
+        entries.push_back({ item.path(), lastUsed, size });
+        totalSize += size;
+    }
+
+    if (totalSize <= m_maxSize)
+    {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const auto &left, const auto &right) { return left.LastUsed < right.LastUsed; });
+    for (const auto &entry : entries)
+    {
+        if (totalSize <= m_maxSize)
+        {
+            break;
+        }
+
+        // Removing an entry that is being copied fails; it is simply skipped.
+        std::error_code error;
+        if (std::filesystem::remove(entry.Path, error))
+        {
+            totalSize -= entry.Size;
+        }
+    }
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "audio.h"
+
+namespace util
+{
+
+// Computes a key that identifies the result of an encode, from the decoded samples and the
+// settings that affect the encoded output. Inputs that decode to the same audio get the same key,
+// regardless of their container or tags.
+class ContentHasher final : public audio::ISampleProcessor
+{
+public:
+    ContentHasher(const audio::AudioFormat &format, UINT32 avgBytesPerSecond);
+
+    void ProcessSamples(std::span<const float> samples) override;
+
+    // Finishes the hash and returns it as a hexadecimal string. Can only be called once.
+    std::wstring GetKey();
+
+private:
+    void HashData(const void *data, size_t size);
+
+    wil::unique_bcrypt_hash m_hash;
+};
+
+// A directory of encoded outputs, named by their content key. When the total size exceeds the
+// maximum, the least recently used entries are removed. The directory can be shared by several
+// processes.
+class OutputCache
+{
+public:
+    OutputCache(std::filesystem::path directory, UINT64 maxSize);
+
+    // Copies the entry with the specified key to the output path. Returns false if there is no
+    // such entry.
+    bool TryGet(std::wstring_view key, const std::filesystem::path &output);
+
+    // Stores a copy of the output under the specified key. This is best-effort, since the output
+    // itself is complete either way; returns false if the entry could not be stored.
+    bool Add(std::wstring_view key, const std::filesystem::path &output);
+
+private:
+    std::filesystem::path GetEntryPath(std::wstring_view key) const;
+    void Evict();
+
+    std::filesystem::path m_directory;
+    UINT64 m_maxSize;
+    std::mutex m_mutex;
+};
+
+}
@@ -0,0 +1,243 @@
+#include "precomp.h"
+#include "pcmring.h"
+
+namespace audio
+{
+
+// The data starts on its own page, after the header.
+constexpr UINT64 c_ringDataOffset = 4096;
+// How long a consumer waits for a producer that is still initializing the header.
+constexpr std::chrono::milliseconds c_ringInitializeTimeout{1000};
+
+static_assert(sizeof(PcmRingHeader) <= c_ringDataOffset);
+
+PcmRingWriter::PcmRingWriter(const std::wstring &name, const AudioFormat &format, UINT64 capacityFrames)
+    : m_format{format}
+{
+    // The synchronization objects are created first, so they exist once a consumer can open the
+    // mapping. The producer mutex is owned until the writer is destroyed.
+    m_producerMutex.reset(CreateMutexW(nullptr, TRUE, (name + L".producer").c_str()));
+    THROW_LAST_ERROR_IF(!m_producerMutex);
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        throw std::runtime_error("A ring buffer with this name already has a producer.");
+    }
+
+    m_dataEvent.reset(CreateEventW(nullptr, FALSE, FALSE, (name + L".data").c_str()));
+    THROW_LAST_ERROR_IF(!m_dataEvent);
+    m_spaceEvent.reset(CreateEventW(nullptr, FALSE, FALSE, (name + L".space").c_str()));
+    THROW_LAST_ERROR_IF(!m_spaceEvent);
+    m_consumerMutex.reset(CreateMutexW(nullptr, FALSE, (name + L".consumer").c_str()));
+    THROW_LAST_ERROR_IF(!m_consumerMutex);
+
+    auto size = c_ringDataOffset + capacityFrames * format.GetFrameSize();
+    m_mapping.reset(CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                       static_cast<DWORD>(size), name.c_str()));
+
+    THROW_LAST_ERROR_IF(!m_mapping);
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        throw std::runtime_error("A ring buffer with this name already exists.");
+    }
+
+    auto view = MapViewOfFile(m_mapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    THROW_LAST_ERROR_IF(!view);
+    m_header.reset(new (view) PcmRingHeader{});
+    m_header->Magic = PcmRingHeader::c_magic;
+    m_header->Version = PcmRingHeader::c_version;
+    m_header->SamplesPerSecond = format.SamplesPerSecond;
+    m_header->Channels = format.Channels;
+    m_header->CapacityFrames = capacityFrames;
+    m_header->DataOffset = c_ringDataOffset;
+    m_data = reinterpret_cast<float *>(static_cast<BYTE *>(view) + c_ringDataOffset);
+    m_header->State.store(PcmRingHeader::StateStreaming, std::memory_order_release);
+}
+
+PcmRingWriter::~PcmRingWriter()
+{
+    // If the stream was not finished, the consumer sees the mutex released without the finished
+    // state, and reports an error.
+    m_producerMutex.ReleaseMutex();
+}
+
+void PcmRingWriter::Write(std::span<const float> samples)
+{
+    auto channels = m_format.Channels;
+    auto capacity = m_header->CapacityFrames;
+    auto write = m_header->WritePosition.load(std::memory_order_relaxed);
+    while (samples.size() >= channels)
+    {
+        auto read = m_header->ReadPosition.load(std::memory_order_acquire);
+        auto space = capacity - (write - read);
+        if (space == 0)
+        {
+            WaitForSpace();
+            continue;
+        }
+
+        auto index = write % capacity;
+        auto frames = std::min({ space, capacity - index, static_cast<UINT64>(samples.size() / channels) });
+        auto count = static_cast<size_t>(frames * channels);
+        std::copy_n(samples.data(), count, m_data + index * channels);
+        samples = samples.subspan(count);
+        write += frames;
+        m_header->WritePosition.store(write, std::memory_order_release);
+        m_dataEvent.SetEvent();
+    }
+}
+
+void PcmRingWriter::WaitForSpace()
+{
+    // Until a consumer connects, the consumer mutex is not owned, so only the event is waited for.
+    // The consumer sets the event after it connects.
+    if (m_header->ConsumerConnected.load(std::memory_order_acquire) == 0)
+    {
+        THROW_LAST_ERROR_IF(WaitForSingleObject(m_spaceEvent.get(), INFINITE) == WAIT_FAILED);
+        return;
+    }
+
+    HANDLE handles[] = { m_spaceEvent.get(), m_consumerMutex.get() };
+    auto result = WaitForMultipleObjects(static_cast<DWORD>(std::size(handles)), handles, FALSE, INFINITE);
+    THROW_LAST_ERROR_IF(result == WAIT_FAILED);
+    if (result == WAIT_OBJECT_0 + 1 || result == WAIT_ABANDONED_0 + 1)
+    {
+        m_consumerMutex.ReleaseMutex();
+        throw std::runtime_error("The consumer closed the ring buffer before the end of the stream.");
+    }
+}
+
+void PcmRingWriter::Finish()
+{
+    m_header->State.store(PcmRingHeader::StateFinished, std::memory_order_release);
+    m_dataEvent.SetEvent();
+}
+
+PcmRingReader::PcmRingReader(const std::wstring &name)
+{
+    m_mapping.reset(OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name.c_str()));
+    if (!m_mapping && GetLastError() == ERROR_FILE_NOT_FOUND)
+    {
+        throw std::runtime_error("The ring buffer does not exist; the producer must be started first.");
+    }
+
+    THROW_LAST_ERROR_IF(!m_mapping);
+    auto view = MapViewOfFile(m_mapping.get(), FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    THROW_LAST_ERROR_IF(!view);
+    m_header.reset(static_cast<PcmRingHeader *>(view));
+
+    auto deadline = std::chrono::steady_clock::now() + c_ringInitializeTimeout;
+    while (m_header->State.load(std::memory_order_acquire) == PcmRingHeader::StateInitializing)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            throw std::runtime_error("The ring buffer was not initialized by the producer.");
+        }
+
+        Sleep(10);
+    }
+
+    if (m_header->Magic != PcmRingHeader::c_magic || m_header->Version != PcmRingHeader::c_version)
+    {
+        throw std::runtime_error("The ring buffer has an unsupported format.");
+    }
+
+    // The header is written by another process, so it's checked against the size of the view
+    // before it's used for any indexing.
+    MEMORY_BASIC_INFORMATION info;
+    THROW_LAST_ERROR_IF(VirtualQuery(view, &info, sizeof(info)) == 0);
+    UINT64 viewSize = info.RegionSize;
+    auto channels = m_header->Channels;
+    auto capacity = m_header->CapacityFrames;
+    auto dataOffset = m_header->DataOffset;
+    if (m_header->SamplesPerSecond == 0 || channels == 0 || capacity == 0 || dataOffset < sizeof(PcmRingHeader) ||
+        dataOffset % alignof(float) != 0 || dataOffset > viewSize ||
+        capacity > (viewSize - dataOffset) / (static_cast<UINT64>(channels) * sizeof(float)))
+    {
+        throw std::runtime_error("The ring buffer header has an invalid format, capacity or data offset.");
+    }
+
+    // Only the validated copies are used from here on, in case the header changes.
+    m_format = { m_header->SamplesPerSecond, channels };
+    m_capacity = capacity;
+    m_data = reinterpret_cast<const float *>(static_cast<const BYTE *>(view) + dataOffset);
+    m_dataEvent.reset(OpenEventW(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, (name + L".data").c_str()));
+    THROW_LAST_ERROR_IF(!m_dataEvent);
+    m_spaceEvent.reset(OpenEventW(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, (name + L".space").c_str()));
+    THROW_LAST_ERROR_IF(!m_spaceEvent);
+    m_producerMutex.reset(OpenMutexW(SYNCHRONIZE | MUTEX_MODIFY_STATE, FALSE, (name + L".producer").c_str()));
+    THROW_LAST_ERROR_IF(!m_producerMutex);
+
+    // A mutex abandoned by an earlier consumer that terminated can be taken over.
+    m_consumerMutex.reset(OpenMutexW(SYNCHRONIZE | MUTEX_MODIFY_STATE, FALSE, (name + L".consumer").c_str()));
+    THROW_LAST_ERROR_IF(!m_consumerMutex);
+    m_consumerLock = m_consumerMutex.acquire(nullptr, 0);
+    if (!m_consumerLock)
+    {
+        throw std::runtime_error("The ring buffer already has a consumer.");
+    }
+
+    m_header->ConsumerConnected.store(1, std::memory_order_release);
+    m_spaceEvent.SetEvent();
+}
+
+std::span<const float> PcmRingReader::ReadBlock()
+{
+    // The previous block is no longer in use, so its space can be given back to the producer.
+    if (m_header->ReadPosition.load(std::memory_order_relaxed) != m_position)
+    {
+        m_header->ReadPosition.store(m_position, std::memory_order_release);
+        m_spaceEvent.SetEvent();
+    }
+
+    auto capacity = m_capacity;
+    for (;;)
+    {
+        auto write = m_header->WritePosition.load(std::memory_order_acquire);
+        if (write > m_position)
+        {
+            // Only the part up to the end of the buffer is returned; the rest follows in the next
+            // block.
+            auto index = m_position % capacity;
+            auto frames = std::min(write - m_position, capacity - index);
+            m_position += frames;
+            return { m_data + index * m_format.Channels, static_cast<size_t>(frames * m_format.Channels) };
+        }
+
+        // The write position must be checked again after seeing the finished state, because the
+        // last frames may have been written in between.
+        if (m_header->State.load(std::memory_order_acquire) == PcmRingHeader::StateFinished)
+        {
+            if (m_header->WritePosition.load(std::memory_order_acquire) == m_position)
+            {
+                return {};
+            }
+
+            continue;
+        }
+
+        HANDLE handles[] = { m_dataEvent.get(), m_producerMutex.get() };
+        auto result = WaitForMultipleObjects(static_cast<DWORD>(std::size(handles)), handles, FALSE, INFINITE);
+        THROW_LAST_ERROR_IF(result == WAIT_FAILED);
+        if (result == WAIT_OBJECT_0 + 1 || result == WAIT_ABANDONED_0 + 1)
+        {
+            // The producer is gone. That's only an error if it didn't finish the stream.
+            m_producerMutex.ReleaseMutex();
+            if (m_header->State.load(std::memory_order_acquire) != PcmRingHeader::StateFinished)
+            {
+                throw std::runtime_error("The producer closed the ring buffer without finishing the stream.");
+            }
+        }
+    }
+}
+
+AudioFormat PcmRingReader::GetFormat() const
+{
+    return m_format;
+}
+
+util::WindowsTimeUnits PcmRingReader::GetDuration() const
+{
+    return {};
+}
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "audio.h"
+
+namespace audio
+{
+
+// A single-producer, single-consumer ring buffer of interleaved 32-bit float samples in a named
+// shared memory section, so another process can hand audio to the encoder without writing a file.
+//
+// For a ring with the name N, the producer creates:
+// - A file mapping named N, starting with a PcmRingHeader, followed by the data at DataOffset.
+// - An auto-reset event named N.data, set after advancing WritePosition or changing State.
+// - An auto-reset event named N.space, set by the consumer after advancing ReadPosition.
+// - A mutex named N.producer, which the producer owns until it exits, so the consumer can tell
+//   if the producer terminated without finishing the stream.
+// - A mutex named N.consumer, which the consumer owns until it exits. The consumer sets
+//   ConsumerConnected and N.space after acquiring it, so a producer waiting for space can tell if
+//   the consumer exited or terminated before reading the whole stream. Only one consumer can own
+//   the mutex at a time.
+//
+// The positions are total frame counts since the start of the stream; frame i is stored at
+// DataOffset + (i % CapacityFrames) * Channels * 4. The producer may only write while
+// WritePosition - ReadPosition is less than CapacityFrames, and the consumer may only read frames
+// before WritePosition. Positions are stored with release semantics, and loaded with acquire
+// semantics.
+struct PcmRingHeader
+{
+    static constexpr UINT32 c_magic = 0x4252464d; // "MFRB"
+    static constexpr UINT32 c_version = 2;
+
+    enum : UINT32
+    {
+        // The header is not initialized yet.
+        StateInitializing = 0,
+        StateStreaming = 1,
+        // The producer has written all frames.
+        StateFinished = 2,
+    };
+
+    UINT32 Magic;
+    UINT32 Version;
+    UINT32 SamplesPerSecond;
+    UINT32 Channels;
+    UINT64 CapacityFrames;
+    UINT64 DataOffset;
+    std::atomic<UINT32> State;
+    // Set to 1 by the consumer after it acquires N.consumer; it's never reset.
+    std::atomic<UINT32> ConsumerConnected;
+    // The positions are on separate cache lines, since each is written by a different process.
+    alignas(64) std::atomic<UINT64> WritePosition;
+    alignas(64) std::atomic<UINT64> ReadPosition;
+};
+
+static_assert(std::atomic<UINT64>::is_always_lock_free, "Shared memory atomics must be lock-free.");
+
+// The producer side of a ring. This is a reference implementation for producers, and is also
+// used by the -FeedRing option.
+class PcmRingWriter
+{
+public:
+    PcmRingWriter(const std::wstring &name, const AudioFormat &format, UINT64 capacityFrames);
+    ~PcmRingWriter();
+
+    // Copies the samples into the ring, waiting for the consumer whenever the ring is full. Throws
+    // if the consumer exits while the producer is waiting.
+    void Write(std::span<const float> samples);
+
+    // Marks the end of the stream.
+    void Finish();
+
+private:
+    void WaitForSpace();
+
+    wil::unique_handle m_mapping;
+    wil::unique_mapview_ptr<PcmRingHeader> m_header;
+    wil::unique_event m_dataEvent;
+    wil::unique_event m_spaceEvent;
+    wil::unique_mutex m_producerMutex;
+    wil::unique_mutex m_consumerMutex;
+    float *m_data{};
+    AudioFormat m_format;
+};
+
+// Reads from a ring created by a producer. The blocks returned by ReadBlock point directly into the
+// shared memory, and the space they use is released to the producer on the next call.
+class PcmRingReader final : public ISampleReader
+{
+public:
+    PcmRingReader(const std::wstring &name);
+
+    std::span<const float> ReadBlock() override;
+    AudioFormat GetFormat() const override;
+    // The duration of a stream is not known in advance, so this returns zero.
+    util::WindowsTimeUnits GetDuration() const override;
+
+private:
+    wil::unique_handle m_mapping;
+    wil::unique_mapview_ptr<PcmRingHeader> m_header;
+    wil::unique_event m_dataEvent;
+    wil::unique_event m_spaceEvent;
+    wil::unique_mutex m_producerMutex;
+    wil::unique_mutex m_consumerMutex;
+    // Holds the consumer mutex until the reader is destroyed.
+    wil::mutex_release_scope_exit m_consumerLock;
+    const float *m_data{};
+    AudioFormat m_format{};
+    UINT64 m_capacity{};
+    UINT64 m_position{};
+};
+
+}
\ No newline at end of file
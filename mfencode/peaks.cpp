@@ -0,0 +1,157 @@
+#include "precomp.h"
+#include "peaks.h"
+#include "simd.h"
+
+namespace audio
+{
+
+constexpr UINT32 c_peaksVersion = 1;
+// Each level must be a multiple of the first.
+constexpr UINT32 c_peakLevels[] = { 256, 1024, 4096 };
+
+namespace
+{
+
+void WriteUInt32(std::ofstream &file, UINT32 value)
+{
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+}
+
+PeakWriter::PeakWriter(const AudioFormat &format, const std::filesystem::path &path)
+    : m_format{format},
+      m_currentMin(format.Channels, std::numeric_limits<float>::max()),
+      m_currentMax(format.Channels, std::numeric_limits<float>::lowest())
+{
+    m_file.exceptions(std::ios::failbit | std::ios::badbit);
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+}
+
+void PeakWriter::ProcessSamples(std::span<const float> samples)
+{
+    // Split the block at pixel boundaries.
+    while (samples.size() >= m_format.Channels)
+    {
+        auto frames = std::min(samples.size() / m_format.Channels, c_peakLevels[0] - m_pixelPosition);
+        ProcessSegment(samples.data(), frames);
+        samples = samples.subspan(frames * m_format.Channels);
+        m_pixelPosition += frames;
+        if (m_pixelPosition == c_peakLevels[0])
+        {
+            EndPixel();
+        }
+    }
+}
+
+void PeakWriter::Save(float gain)
+{
+    if (m_pixelPosition > 0)
+    {
+        EndPixel();
+    }
+
+    m_file.write("MFPK", 4);
+    WriteUInt32(m_file, c_peaksVersion);
+    WriteUInt32(m_file, m_format.SamplesPerSecond);
+    WriteUInt32(m_file, m_format.Channels);
+    WriteUInt32(m_file, static_cast<UINT32>(std::size(c_peakLevels)));
+
+    auto pixelSize = m_format.Channels * 2;
+    auto pixelCount = m_pixels.size() / pixelSize;
+    for (auto samplesPerPixel : c_peakLevels)
+    {
+        auto ratio = samplesPerPixel / c_peakLevels[0];
+        WriteUInt32(m_file, samplesPerPixel);
+        WriteUInt32(m_file, static_cast<UINT32>((pixelCount + ratio - 1) / ratio));
+    }
+
+    std::vector<float> level;
+    std::vector<int16_t> converted;
+    for (auto samplesPerPixel : c_peakLevels)
+    {
+        auto ratio = samplesPerPixel / c_peakLevels[0];
+        level.clear();
+        for (size_t pixel = 0; pixel < pixelCount; pixel += ratio)
+        {
+            auto end = std::min<size_t>(pixel + ratio, pixelCount);
+            for (size_t channel = 0; channel < m_format.Channels; ++channel)
+            {
+                auto minimum = std::numeric_limits<float>::max();
+                auto maximum = std::numeric_limits<float>::lowest();
+                for (auto source = pixel; source < end; ++source)
+                {
+                    minimum = std::min(minimum, m_pixels[source * pixelSize + channel * 2]);
+                    maximum = std::max(maximum, m_pixels[source * pixelSize + channel * 2 + 1]);
+                }
+
+                level.push_back(minimum);
+                level.push_back(maximum);
+            }
+        }
+
+        // Use the same scale and rounding as the samples passed to the encoder.
+        converted.resize(level.size());
+        ConvertToInt16(level, converted.data(), gain);
+        m_file.write(reinterpret_cast<const char *>(converted.data()), converted.size() * sizeof(int16_t));
+    }
+
+    m_file.close();
+}
+
+void PeakWriter::ProcessSegment(const float *samples, size_t frames)
+{
+    // Four frames span exactly as many vectors as there are channels, and lane l of the j'th vector
+    // always holds channel (4j + l) % channels. Each vector position is reduced separately, so the
+    // accumulators stay in registers.
+    auto channels = m_format.Channels;
+    auto groups = frames / 4;
+    if (groups > 0)
+    {
+        for (size_t vector = 0; vector < channels; ++vector)
+        {
+            const float *input = samples + vector * 4;
+            auto minimum = simd::Load(input);
+            auto maximum = minimum;
+            for (size_t group = 1; group < groups; ++group)
+            {
+                auto value = simd::Load(input + group * channels * 4);
+                minimum = simd::Min(minimum, value);
+                maximum = simd::Max(maximum, value);
+            }
+
+            float minimumLanes[4];
+            float maximumLanes[4];
+            simd::Store(minimumLanes, minimum);
+            simd::Store(maximumLanes, maximum);
+            for (size_t lane = 0; lane < 4; ++lane)
+            {
+                auto channel = (vector * 4 + lane) % channels;
+                m_currentMin[channel] = std::min(m_currentMin[channel], minimumLanes[lane]);
+                m_currentMax[channel] = std::max(m_currentMax[channel], maximumLanes[lane]);
+            }
+        }
+    }
+
+    for (size_t index = groups * 4 * channels; index < frames * channels; ++index)
+    {
+        auto channel = index % channels;
+        m_currentMin[channel] = std::min(m_currentMin[channel], samples[index]);
+        m_currentMax[channel] = std::max(m_currentMax[channel], samples[index]);
+    }
+}
+
+void PeakWriter::EndPixel()
+{
+    for (size_t channel = 0; channel < m_format.Channels; ++channel)
+    {
+        m_pixels.push_back(m_currentMin[channel]);
+        m_pixels.push_back(m_currentMax[channel]);
+    }
+
+    std::fill(m_currentMin.begin(), m_currentMin.end(), std::numeric_limits<float>::max());
+    std::fill(m_currentMax.begin(), m_currentMax.end(), std::numeric_limits<float>::lowest());
+    m_pixelPosition = 0;
+}
+
+}
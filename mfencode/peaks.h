@@ -0,0 +1,43 @@
+#pragma once
+
+#include "audio.h"
+
+namespace audio
+{
+
+// Computes minimum and maximum waveform peaks at several resolutions, so a player can draw a
+// waveform without decoding the audio.
+//
+// The peaks file is little-endian, and has the following layout:
+// - The magic "MFPK", followed by the version (1), sample rate, channel count and level count, all
+//   as UINT32.
+// - For each level, the number of samples per pixel and the number of pixels, as UINT32.
+// - For each level, in the same order, the pixels. Each pixel contains the minimum and maximum
+//   value of each channel, as INT16.
+class PeakWriter final : public ISampleProcessor
+{
+public:
+    // Creates the peaks file immediately, so an invalid path is reported before encoding starts.
+    PeakWriter(const AudioFormat &format, const std::filesystem::path &path);
+
+    void ProcessSamples(std::span<const float> samples) override;
+
+    // Writes the peaks file. The gain is applied to the peaks to match any gain applied to the
+    // encoded output.
+    void Save(float gain = 1.0f);
+
+private:
+    void ProcessSegment(const float *samples, size_t frames);
+    void EndPixel();
+
+    AudioFormat m_format;
+    std::ofstream m_file;
+    // The minimum and maximum of each channel for every pixel of the finest level. Coarser levels
+    // are derived from these when saving.
+    std::vector<float> m_pixels;
+    std::vector<float> m_currentMin;
+    std::vector<float> m_currentMax;
+    size_t m_pixelPosition{};
+};
+
+}
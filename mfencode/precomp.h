@@ -4,14 +4,30 @@
 #include <windows.h>
 #include <mfapi.h>
 #include <mfidl.h>
+#include <mfreadwrite.h>
 #include <mferror.h>
 #include <shlwapi.h>
+#include <bcrypt.h>
 #include <io.h>
 
 // STL headers
 #include <iostream>
 #include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <optional>
+#include <span>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <iomanip>
 
 // WIL headers
 #include <wil/result.h>
@@ -0,0 +1,447 @@
+// This file doesn't use the precompiled header, so it can be built on other platforms.
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <ookii/console_helper.h>
+#include <ookii/vt_helper.h>
+#include "progress.h"
+#include "duration.h"
+
+using namespace std;
+
+namespace util
+{
+
+// When not writing to a terminal, log lines are written at this interval.
+constexpr std::chrono::seconds c_progressLogInterval{5};
+// With more jobs than this, only jobs that are in progress are shown, up to this many lines.
+constexpr size_t c_maxJobLines = 8;
+// Job names are shortened to leave at least this much room for the progress bar.
+constexpr size_t c_minBarSize = 10;
+// Replaces the end of a job name that was shortened to fit.
+constexpr std::wstring_view c_ellipsis = L"...";
+
+namespace
+{
+
+struct WriteColor
+{
+    WriteColor(bool useColor, const char *color)
+        : Color{useColor ? color : nullptr}
+    {
+    }
+
+    const char *Color;
+};
+
+std::wostream &operator<<(std::wostream &stream, WriteColor color)
+{
+    if (color.Color != nullptr)
+    {
+        stream << color.Color;
+    }
+
+    return stream;
+}
+
+// Returns the number of wchar_t values of the code point at the start of the text, which is two
+// for a surrogate pair if wchar_t is UTF-16.
+size_t GetCodePointLength(std::wstring_view text)
+{
+    if constexpr (sizeof(wchar_t) == 2)
+    {
+        if (text.size() >= 2 && text[0] >= 0xD800 && text[0] <= 0xDBFF && text[1] >= 0xDC00 && text[1] <= 0xDFFF)
+        {
+            return 2;
+        }
+    }
+
+    return 1;
+}
+
+char32_t GetCodePoint(std::wstring_view text, size_t length)
+{
+    if (length == 2)
+    {
+        return 0x10000 + ((static_cast<char32_t>(text[0]) - 0xD800) << 10) + (static_cast<char32_t>(text[1]) - 0xDC00);
+    }
+
+    return static_cast<char32_t>(text[0]);
+}
+
+// Returns the number of console columns a code point uses. This covers combining marks and the
+// common East Asian wide ranges, which is enough for file names; it doesn't need to be exact for
+// every script.
+size_t GetColumnWidth(char32_t codePoint)
+{
+    constexpr std::pair<char32_t, char32_t> zeroWidth[] = {
+        { 0x0300, 0x036F }, { 0x1AB0, 0x1AFF }, { 0x1DC0, 0x1DFF }, { 0x200B, 0x200F },
+        { 0x20D0, 0x20FF }, { 0xFE00, 0xFE0F }, { 0xFE20, 0xFE2F },
+    };
+
+    constexpr std::pair<char32_t, char32_t> doubleWidth[] = {
+        { 0x1100, 0x115F }, { 0x2E80, 0x303E }, { 0x3041, 0x33FF }, { 0x3400, 0x4DBF },
+        { 0x4E00, 0x9FFF }, { 0xA000, 0xA4CF }, { 0xAC00, 0xD7A3 }, { 0xF900, 0xFAFF },
+        { 0xFE30, 0xFE4F }, { 0xFF00, 0xFF60 }, { 0xFFE0, 0xFFE6 }, { 0x1F300, 0x1F64F },
+        { 0x1F900, 0x1F9FF }, { 0x20000, 0x3FFFD },
+    };
+
+    auto inRange = [codePoint](const auto &range) { return codePoint >= range.first && codePoint <= range.second; };
+    if (std::any_of(std::begin(zeroWidth), std::end(zeroWidth), inRange))
+    {
+        return 0;
+    }
+
+    return std::any_of(std::begin(doubleWidth), std::end(doubleWidth), inRange) ? 2 : 1;
+}
+
+size_t GetColumnWidth(std::wstring_view text)
+{
+    size_t width{};
+    while (!text.empty())
+    {
+        auto length = GetCodePointLength(text);
+        width += GetColumnWidth(GetCodePoint(text, length));
+        text.remove_prefix(length);
+    }
+
+    return width;
+}
+
+// Shortens the text so it uses at most the specified number of console columns, ending it with an
+// ellipsis if anything was removed.
+std::wstring_view TruncateToWidth(std::wstring_view text, size_t maxWidth, std::wstring &buffer)
+{
+    if (GetColumnWidth(text) <= maxWidth)
+    {
+        return text;
+    }
+
+    if (maxWidth < c_ellipsis.size())
+    {
+        return c_ellipsis.substr(0, maxWidth);
+    }
+
+    size_t width{};
+    size_t end{};
+    while (end < text.size())
+    {
+        auto length = GetCodePointLength(text.substr(end));
+        auto charWidth = GetColumnWidth(GetCodePoint(text.substr(end), length));
+        if (width + charWidth > maxWidth - c_ellipsis.size())
+        {
+            break;
+        }
+
+        width += charWidth;
+        end += length;
+    }
+
+    buffer.assign(text.substr(0, end));
+    buffer += c_ellipsis;
+    return buffer;
+}
+
+}
+
+ProgressRenderer::ProgressRenderer(bool virtualTerminal, std::chrono::milliseconds frameInterval)
+    : m_frameInterval{frameInterval},
+      m_start{std::chrono::steady_clock::now()},
+      m_terminal{IsOutputTerminal()},
+      m_virtualTerminal{virtualTerminal && m_terminal}
+{
+}
+
+ProgressRenderer::~ProgressRenderer()
+{
+    if (m_cursorHidden)
+    {
+        SetConsoleCursorVisible(true);
+    }
+}
+
+size_t ProgressRenderer::AddJob(std::wstring name, std::chrono::nanoseconds duration)
+{
+    m_jobs.push_back({ std::move(name), duration, 0.0f, false });
+    return m_jobs.size() - 1;
+}
+
+void ProgressRenderer::SetDuration(size_t job, std::chrono::nanoseconds duration)
+{
+    m_jobs[job].Duration = duration;
+}
+
+void ProgressRenderer::SetProgress(size_t job, float progress)
+{
+    // Progress can briefly go backwards or past the end due to clock inaccuracy.
+    m_jobs[job].Progress = std::clamp(std::max(progress, m_jobs[job].Progress), 0.0f, 1.0f);
+}
+
+void ProgressRenderer::SetCompleted(size_t job)
+{
+    m_jobs[job].Progress = 1.0f;
+    m_jobs[job].Completed = true;
+}
+
+void ProgressRenderer::Render(bool force)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto interval = m_terminal ? m_frameInterval : std::chrono::duration_cast<std::chrono::milliseconds>(c_progressLogInterval);
+    if (!force && m_linesDrawn > 0 && now - m_lastRender < interval)
+    {
+        return;
+    }
+
+    m_lastRender = now;
+    m_frame.str(std::wstring{});
+    if (m_terminal)
+    {
+        ComposeFrame();
+    }
+    else
+    {
+        ComposeLogLine();
+    }
+
+    WriteOutput(m_frame.view());
+}
+
+void ProgressRenderer::Finish()
+{
+    if (m_finished)
+    {
+        return;
+    }
+
+    Render(true);
+    m_finished = true;
+    if (m_terminal)
+    {
+        WriteOutput(m_virtualTerminal ? L"\x1b[?25h\n" : L"\n");
+    }
+
+    if (m_cursorHidden)
+    {
+        SetConsoleCursorVisible(true);
+    }
+}
+
+void ProgressRenderer::ComposeFrame()
+{
+    auto width = static_cast<size_t>(ookii::get_console_width());
+
+    // Without virtual terminal sequences, only a single line can be redrawn, and the cursor is
+    // hidden using the console instead.
+    if (!m_virtualTerminal)
+    {
+        if (!m_cursorHidden)
+        {
+            SetConsoleCursorVisible(false);
+        }
+
+        m_frame << L'\r';
+        if (m_jobs.size() == 1)
+        {
+            ComposeJobLine(m_jobs[0], width);
+        }
+        else
+        {
+            ComposeTotalsLine(width);
+        }
+
+        m_linesDrawn = 1;
+        return;
+    }
+
+    // Move back to the start of the previous frame, hiding the cursor while drawing.
+    m_frame << L"\x1b[?25l";
+    if (m_linesDrawn > 1)
+    {
+        m_frame << L"\x1b[" << (m_linesDrawn - 1) << L'A';
+    }
+
+    m_frame << L'\r';
+    size_t lines = 0;
+    for (const auto &job : m_jobs)
+    {
+        if (m_jobs.size() > c_maxJobLines && (job.Completed || job.Progress == 0.0f))
+        {
+            continue;
+        }
+
+        if (lines == c_maxJobLines)
+        {
+            break;
+        }
+
+        if (lines > 0)
+        {
+            m_frame << L'\n';
+        }
+
+        ComposeJobLine(job, width);
+        m_frame << L"\x1b[K";
+        ++lines;
+    }
+
+    if (m_jobs.size() > 1)
+    {
+        if (lines > 0)
+        {
+            m_frame << L'\n';
+        }
+
+        ComposeTotalsLine(width);
+        m_frame << L"\x1b[K";
+        ++lines;
+    }
+
+    // Clear anything left over below the frame.
+    m_frame << L"\x1b[J";
+    m_linesDrawn = lines;
+}
+
+void ProgressRenderer::ComposeLogLine()
+{
+    if (m_jobs.size() == 1)
+    {
+        m_frame << m_jobs[0].Name << L": " << fixed << setprecision(0) << (100 * m_jobs[0].Progress) << L"%; ";
+    }
+
+    ComposeTotals(m_frame);
+    m_frame << L'\n';
+    m_linesDrawn = 1;
+}
+
+void ProgressRenderer::ComposeJobLine(const Job &job, size_t width)
+{
+    // The last column is left empty so the console doesn't wrap the line. Besides the name and the
+    // bar, the line contains ": ", [], a space before the percent and the percent value.
+    constexpr size_t fixedWidth = 2 + 2 + 1 + 4;
+    auto available = width > 0 ? width - 1 : 0;
+    std::wstring buffer;
+    if (available < fixedWidth + c_minBarSize + c_ellipsis.size())
+    {
+        std::wostringstream line;
+        line << fixed << setprecision(0) << (100 * job.Progress) << L'%';
+        auto percent = line.str();
+        auto nameWidth = available > percent.size() + 2 ? available - percent.size() - 2 : 0;
+        if (nameWidth == 0)
+        {
+            m_frame << TruncateToWidth(percent, available, buffer);
+            return;
+        }
+
+        m_frame << TruncateToWidth(job.Name, nameWidth, buffer) << L": " << percent;
+        return;
+    }
+
+    auto name = TruncateToWidth(job.Name, available - fixedWidth - c_minBarSize, buffer);
+    auto barSize = available - fixedWidth - GetColumnWidth(name);
+    auto barFilled = static_cast<size_t>(barSize * job.Progress);
+    auto iterator = std::ostreambuf_iterator<wchar_t>{m_frame};
+    m_frame << name << L": " << WriteColor(m_virtualTerminal, ookii::vt::text_format::bright_foreground_blue) << L'['
+            << WriteColor(m_virtualTerminal, ookii::vt::text_format::bright_foreground_green);
+
+    std::fill_n(iterator, barFilled, L'=');
+    std::fill_n(iterator, barSize - barFilled, L' ');
+    m_frame << WriteColor(m_virtualTerminal, ookii::vt::text_format::bright_foreground_blue) << L"] "
+            << WriteColor(m_virtualTerminal, ookii::vt::text_format::default_format)
+            << fixed << setw(3) << setfill(L' ') << setprecision(0) << (100 * job.Progress) << L'%';
+}
+
+void ProgressRenderer::ComposeTotalsLine(size_t width)
+{
+    std::wostringstream line;
+    ComposeTotals(line);
+    std::wstring buffer;
+    m_frame << TruncateToWidth(line.view(), width > 0 ? width - 1 : 0, buffer);
+}
+
+void ProgressRenderer::ComposeTotals(std::wostream &stream)
+{
+    std::chrono::nanoseconds total{};
+    double processed{};
+    size_t completed{};
+    for (const auto &job : m_jobs)
+    {
+        total += job.Duration;
+        processed += job.Progress * job.Duration.count();
+        if (job.Completed)
+        {
+            ++completed;
+        }
+    }
+
+    if (m_jobs.size() > 1)
+    {
+        stream << L"Total: " << completed << L'/' << m_jobs.size() << L" jobs; ";
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+    if (elapsed.count() <= 0 || processed <= 0.0)
+    {
+        stream << L"ETA unknown";
+        return;
+    }
+
+    auto speed = processed / elapsed.count();
+    std::chrono::nanoseconds remaining{static_cast<long long>((total.count() - processed) / speed)};
+    stream << fixed << setprecision(1) << speed << L"x realtime; ETA " << DurationPrinter{remaining, 0};
+}
+
+void ProgressRenderer::SetConsoleCursorVisible(bool visible)
+{
+#ifdef _WIN32
+    // Failing to change the cursor only affects how the output looks, so errors are ignored.
+    auto handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_CURSOR_INFO info{};
+    if (GetConsoleCursorInfo(handle, &info))
+    {
+        info.bVisible = visible;
+        SetConsoleCursorInfo(handle, &info);
+    }
+#endif
+
+    m_cursorHidden = !visible;
+}
+
+bool IsOutputTerminal()
+{
+#ifdef _WIN32
+    return _isatty(_fileno(stdout)) != 0;
+#else
+    return isatty(fileno(stdout)) != 0;
+#endif
+}
+
+void WriteOutput(std::wstring_view text)
+{
+    wcout.flush();
+#ifdef _WIN32
+    // WriteConsoleW writes the whole frame at once, bypassing the stream's per-character
+    // conversion.
+    auto handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    if (GetConsoleMode(handle, &mode))
+    {
+        DWORD written;
+        WriteConsoleW(handle, text.data(), static_cast<DWORD>(text.size()), &written, nullptr);
+        return;
+    }
+#endif
+
+    wcout.write(text.data(), text.size());
+    wcout.flush();
+}
+
+}
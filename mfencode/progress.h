@@ -0,0 +1,71 @@
+#pragma once
+
+// The renderer only depends on the standard library and Ookii.CommandLine, so it can be used on
+// other platforms.
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace util
+{
+
+// Shows the progress of one or more jobs. Each frame is composed in a single buffer and written
+// with one call, and frames are throttled to a fixed rate. If standard output is not a terminal,
+// periodic log lines are written instead.
+class ProgressRenderer
+{
+public:
+    ProgressRenderer(bool virtualTerminal, std::chrono::milliseconds frameInterval = std::chrono::milliseconds{100});
+    ~ProgressRenderer();
+
+    ProgressRenderer(const ProgressRenderer &) = delete;
+    ProgressRenderer &operator=(const ProgressRenderer &) = delete;
+
+    size_t AddJob(std::wstring name, std::chrono::nanoseconds duration);
+    // Sets the duration of a job that wasn't known when it was added.
+    void SetDuration(size_t job, std::chrono::nanoseconds duration);
+    void SetProgress(size_t job, float progress);
+    void SetCompleted(size_t job);
+
+    // Draws a frame if the frame interval has passed since the last one, or if force is true.
+    void Render(bool force = false);
+
+    // Draws the final frame and ends the output.
+    void Finish();
+
+private:
+    struct Job
+    {
+        std::wstring Name;
+        std::chrono::nanoseconds Duration;
+        float Progress;
+        bool Completed;
+    };
+
+    void ComposeFrame();
+    void ComposeLogLine();
+    void ComposeJobLine(const Job &job, size_t width);
+    void ComposeTotalsLine(size_t width);
+    void ComposeTotals(std::wostream &stream);
+    void SetConsoleCursorVisible(bool visible);
+
+    std::vector<Job> m_jobs;
+    std::wostringstream m_frame;
+    std::chrono::milliseconds m_frameInterval;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_lastRender;
+    size_t m_linesDrawn{};
+    bool m_terminal;
+    bool m_virtualTerminal;
+    bool m_finished{};
+    bool m_cursorHidden{};
+};
+
+bool IsOutputTerminal();
+
+// Writes the text to standard output with a single call.
+void WriteOutput(std::wstring_view text);
+
+}
@@ -0,0 +1,367 @@
+#include "precomp.h"
+#include "resume.h"
+
+namespace mf
+{
+
+constexpr UINT32 c_checkpointVersion = 1;
+// Number of PCM frames in each AAC-LC access unit.
+constexpr UINT32 c_aacFrameSize = 1024;
+// Approximate length of a segment; it's rounded up to whole AAC frames.
+constexpr UINT32 c_segmentSeconds = 60;
+// Frames of preceding audio encoded at the start of each segment after the first. This covers the
+// encoder delay plus the overlap of the first frame.
+constexpr UINT32 c_prerollFrames = 4 * c_aacFrameSize;
+
+namespace
+{
+
+UINT64 GetLastWriteTime(const std::filesystem::path &path)
+{
+    return static_cast<UINT64>(std::filesystem::last_write_time(path).time_since_epoch().count());
+}
+
+// Writes the file under a temporary name, flushes it, and then replaces the destination, so the
+// destination is never partially written.
+void WriteFileAtomic(const std::filesystem::path &path, const void *data, DWORD size)
+{
+    auto temp = path;
+    temp += L".tmp";
+    {
+        wil::unique_hfile file{CreateFileW(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                                           nullptr)};
+
+        THROW_LAST_ERROR_IF(!file);
+        DWORD written;
+        THROW_IF_WIN32_BOOL_FALSE(WriteFile(file.get(), data, size, &written, nullptr));
+        THROW_IF_WIN32_BOOL_FALSE(FlushFileBuffers(file.get()));
+    }
+
+    THROW_IF_WIN32_BOOL_FALSE(MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH));
+}
+
+void FlushFile(const std::filesystem::path &path)
+{
+    wil::unique_hfile file{CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                       FILE_ATTRIBUTE_NORMAL, nullptr)};
+
+    THROW_LAST_ERROR_IF(!file);
+    THROW_IF_WIN32_BOOL_FALSE(FlushFileBuffers(file.get()));
+}
+
+// Copies the AAC access units of the segments into a single MPEG-4 file without re-encoding. Of
+// each segment, skipUnits access units are dropped, and then at most unitCount are copied, or all
+// of the remaining ones for the last segment.
+void JoinSegments(const std::filesystem::path &output, std::span<const std::filesystem::path> segments, UINT32 skipUnits,
+                  UINT32 unitCount, UINT32 samplesPerSecond)
+{
+    wil::com_ptr<IMFSinkWriter> writer;
+    DWORD streamIndex{};
+    UINT64 units{};
+    for (size_t index = 0; index < segments.size(); ++index)
+    {
+        MediaSource source{segments[index].c_str()};
+        auto attributes = CreateAttributes(1);
+        AttributeHelper{attributes}.Set(MF_SOURCE_READER_DISCONNECT_MEDIASOURCE_ON_SHUTDOWN, TRUE);
+        wil::com_ptr<IMFSourceReader> reader;
+        THROW_IF_FAILED(MFCreateSourceReaderFromMediaSource(source.Get(), attributes.get(), &reader));
+        THROW_IF_FAILED(reader->SetStreamSelection(static_cast<DWORD>(MF_SOURCE_READER_ALL_STREAMS), FALSE));
+        THROW_IF_FAILED(reader->SetStreamSelection(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), TRUE));
+        if (!writer)
+        {
+            // Using the native type for both the input and output makes the sink writer pass the
+            // samples through unchanged.
+            wil::com_ptr<IMFMediaType> type;
+            THROW_IF_FAILED(reader->GetNativeMediaType(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), 0, &type));
+            auto writerAttributes = CreateAttributes(1);
+            AttributeHelper{writerAttributes}.Set(MF_TRANSCODE_CONTAINERTYPE, MFTranscodeContainerType_MPEG4);
+            THROW_IF_FAILED(MFCreateSinkWriterFromURL(output.c_str(), nullptr, writerAttributes.get(), &writer));
+            THROW_IF_FAILED(writer->AddStream(type.get(), &streamIndex));
+            THROW_IF_FAILED(writer->SetInputMediaType(streamIndex, type.get(), nullptr));
+            THROW_IF_FAILED(writer->BeginWriting());
+        }
+
+        bool last = index == segments.size() - 1;
+        UINT32 skip = index == 0 ? 0 : skipUnits;
+        UINT64 read{};
+        for (;;)
+        {
+            DWORD flags;
+            LONGLONG timestamp;
+            wil::com_ptr<IMFSample> sample;
+            THROW_IF_FAILED(reader->ReadSample(static_cast<DWORD>(MF_SOURCE_READER_FIRST_AUDIO_STREAM), 0, nullptr, &flags,
+                                               &timestamp, &sample));
+
+            if (flags & MF_SOURCE_READERF_ENDOFSTREAM)
+            {
+                break;
+            }
+
+            if (!sample)
+            {
+                continue;
+            }
+
+            auto position = read++;
+            if (position < skip)
+            {
+                continue;
+            }
+
+            if (!last && position - skip >= unitCount)
+            {
+                break;
+            }
+
+            auto start = audio::FramesToDuration(units * c_aacFrameSize, samplesPerSecond);
+            auto end = audio::FramesToDuration((units + 1) * c_aacFrameSize, samplesPerSecond);
+            THROW_IF_FAILED(sample->SetSampleTime(start.count()));
+            THROW_IF_FAILED(sample->SetSampleDuration((end - start).count()));
+            THROW_IF_FAILED(writer->WriteSample(streamIndex, sample.get()));
+            ++units;
+        }
+    }
+
+    THROW_IF_FAILED(writer->Finalize());
+}
+
+}
+
+ResumableTranscodeSession::ResumableTranscodeSession(MediaSource &source, const std::filesystem::path &input,
+                                                     const std::filesystem::path &output, int quality)
+    : m_output{output},
+      m_reader{source},
+      m_duration{m_reader.GetDuration()}
+{
+    m_checkpointPath = m_output;
+    m_checkpointPath += L".checkpoint";
+
+    auto format = m_reader.GetFormat();
+    auto segmentFrames = (format.SamplesPerSecond * c_segmentSeconds + c_aacFrameSize - 1) / c_aacFrameSize * c_aacFrameSize;
+    Checkpoint expected{ std::filesystem::file_size(input), GetLastWriteTime(input), GetAacQualityBytesPerSecond(quality),
+                         format.SamplesPerSecond, format.Channels, segmentFrames, 0, 0 };
+
+    // A checkpoint is only used if it was made for the same input and settings.
+    auto checkpoint = LoadCheckpoint();
+    if (checkpoint && checkpoint->InputSize == expected.InputSize && checkpoint->InputLastWriteTime == expected.InputLastWriteTime &&
+        checkpoint->AvgBytesPerSecond == expected.AvgBytesPerSecond && checkpoint->SamplesPerSecond == expected.SamplesPerSecond &&
+        checkpoint->Channels == expected.Channels && checkpoint->SegmentFrames == expected.SegmentFrames)
+    {
+        m_checkpoint = *checkpoint;
+        m_resuming = true;
+    }
+    else
+    {
+        m_checkpoint = expected;
+    }
+
+    m_frames = static_cast<UINT64>(m_checkpoint.CompletedSegments) * m_checkpoint.SegmentFrames;
+}
+
+void ResumableTranscodeSession::Start()
+{
+    m_worker.Start([this](std::stop_token stopToken) { Run(stopToken); });
+}
+
+bool ResumableTranscodeSession::Wait(std::chrono::milliseconds timeout)
+{
+    return m_worker.Wait(timeout);
+}
+
+async::CompletionEvent &ResumableTranscodeSession::Completed()
+{
+    return m_worker.Completed();
+}
+
+util::WindowsTimeUnits ResumableTranscodeSession::GetPosition() const
+{
+    return std::min(audio::FramesToDuration(m_frames, m_checkpoint.SamplesPerSecond), m_duration);
+}
+
+util::WindowsTimeUnits ResumableTranscodeSession::GetDuration() const
+{
+    return m_duration;
+}
+
+float ResumableTranscodeSession::GetProgress() const
+{
+    return CalculateProgress(GetPosition(), m_duration);
+}
+
+util::WindowsTimeUnits ResumableTranscodeSession::GetResumedPosition() const
+{
+    auto frames = static_cast<UINT64>(m_checkpoint.CompletedSegments) * m_checkpoint.SegmentFrames;
+    return std::min(audio::FramesToDuration(frames, m_checkpoint.SamplesPerSecond), m_duration);
+}
+
+bool ResumableTranscodeSession::IsResuming() const
+{
+    return m_resuming;
+}
+
+void ResumableTranscodeSession::Run(std::stop_token stopToken)
+{
+    if (!EncodeSegments(stopToken))
+    {
+        return;
+    }
+
+    std::vector<std::filesystem::path> segments;
+    for (UINT32 segment = 0; segment < m_checkpoint.CompletedSegments; ++segment)
+    {
+        segments.push_back(GetSegmentPath(segment));
+    }
+
+    JoinSegments(m_output, segments, c_prerollFrames / c_aacFrameSize, m_checkpoint.SegmentFrames / c_aacFrameSize,
+                 m_checkpoint.SamplesPerSecond);
+
+    Cleanup();
+}
+
+// Returns false if the session was stopped before all segments were encoded.
+bool ResumableTranscodeSession::EncodeSegments(std::stop_token stopToken)
+{
+    auto format = m_reader.GetFormat();
+    auto channels = format.Channels;
+    auto bytesPerSecond = m_checkpoint.AvgBytesPerSecond;
+    std::vector<float> preroll;
+    std::span<const float> pending;
+
+    // Takes up to the specified number of frames from the reader, invoking the callback for each
+    // contiguous part. Returns the number of frames taken, which is less only at the end of the
+    // input or if the session is stopped.
+    auto take = [this, &pending, &stopToken, channels](UINT64 frames, const auto &callback)
+    {
+        UINT64 taken{};
+        while (taken < frames && !stopToken.stop_requested())
+        {
+            if (pending.empty())
+            {
+                pending = m_reader.ReadBlock();
+                if (pending.empty())
+                {
+                    break;
+                }
+            }
+
+            auto count = std::min<UINT64>(pending.size() / channels, frames - taken);
+            callback(pending.first(static_cast<size_t>(count * channels)));
+            pending = pending.subspan(static_cast<size_t>(count * channels));
+            taken += count;
+        }
+
+        return taken;
+    };
+
+    // Keeps the last frames of the audio, to use as the preroll of the next segment.
+    auto keepTail = [&preroll, channels](std::span<const float> samples)
+    {
+        preroll.insert(preroll.end(), samples.begin(), samples.end());
+        size_t maxSize = c_prerollFrames * channels;
+        if (preroll.size() > maxSize)
+        {
+            preroll.erase(preroll.begin(), preroll.end() - maxSize);
+        }
+    };
+
+    if (m_checkpoint.CompletedSegments > 0 && !m_checkpoint.Finished)
+    {
+        UINT64 start = static_cast<UINT64>(m_checkpoint.CompletedSegments) * m_checkpoint.SegmentFrames;
+        m_reader.Seek(start - c_prerollFrames);
+        take(c_prerollFrames, keepTail);
+    }
+
+    while (!m_checkpoint.Finished)
+    {
+        if (stopToken.stop_requested())
+        {
+            return false;
+        }
+
+        auto path = GetSegmentPath(m_checkpoint.CompletedSegments);
+        {
+            AacSinkWriter writer{path.c_str(), format, bytesPerSecond};
+            writer.Write(preroll, 1.0f);
+            auto frames = take(m_checkpoint.SegmentFrames, [this, &writer, &keepTail, channels](std::span<const float> samples)
+            {
+                writer.Write(samples, 1.0f);
+                keepTail(samples);
+                m_frames += samples.size() / channels;
+            });
+
+            // An unfinished segment is simply encoded again by the next run.
+            if (stopToken.stop_requested())
+            {
+                return false;
+            }
+
+            // Check whether the input ended exactly at the end of this segment.
+            if (frames == m_checkpoint.SegmentFrames && pending.empty())
+            {
+                pending = m_reader.ReadBlock();
+            }
+
+            m_checkpoint.Finished = pending.empty();
+            writer.Finalize();
+        }
+
+        FlushFile(path);
+        ++m_checkpoint.CompletedSegments;
+        SaveCheckpoint();
+    }
+
+    return true;
+}
+
+std::optional<ResumableTranscodeSession::Checkpoint> ResumableTranscodeSession::LoadCheckpoint() const
+{
+    std::ifstream file{m_checkpointPath, std::ios::binary};
+    if (!file)
+    {
+        return {};
+    }
+
+    char magic[4];
+    UINT32 version{};
+    Checkpoint checkpoint{};
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    file.read(reinterpret_cast<char *>(&checkpoint), sizeof(checkpoint));
+    if (!file || std::memcmp(magic, "MFCK", 4) != 0 || version != c_checkpointVersion)
+    {
+        return {};
+    }
+
+    return checkpoint;
+}
+
+void ResumableTranscodeSession::SaveCheckpoint() const
+{
+    static_assert(sizeof(Checkpoint) == 40, "The checkpoint layout must not contain padding.");
+    BYTE data[8 + sizeof(Checkpoint)];
+    std::memcpy(data, "MFCK", 4);
+    std::memcpy(data + 4, &c_checkpointVersion, 4);
+    std::memcpy(data + 8, &m_checkpoint, sizeof(m_checkpoint));
+    WriteFileAtomic(m_checkpointPath, data, sizeof(data));
+}
+
+std::filesystem::path ResumableTranscodeSession::GetSegmentPath(UINT32 segment) const
+{
+    auto result = m_checkpointPath;
+    result += L"." + std::to_wstring(segment) + L".m4a";
+    return result;
+}
+
+void ResumableTranscodeSession::Cleanup()
+{
+    // The checkpoint is removed first, so a failure part way through can't leave a checkpoint
+    // that refers to missing segments.
+    std::filesystem::remove(m_checkpointPath);
+    for (UINT32 segment = 0; segment < m_checkpoint.CompletedSegments; ++segment)
+    {
+        std::error_code error;
+        std::filesystem::remove(GetSegmentPath(segment), error);
+    }
+}
+
+}
\ No newline at end of file
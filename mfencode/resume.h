@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mfutil.h"
+
+namespace mf
+{
+
+// Transcodes in segments that can be resumed after the process is interrupted.
+//
+// The input is encoded in segments whose length is a whole number of AAC frames, each to its own
+// temporary file. Every segment after the first also encodes a few frames of the preceding audio,
+// so the encoder is primed the same way as in a continuous stream; the frames those produce are
+// dropped when the segments are joined. After each segment, a checkpoint file next to the output
+// records how many segments are done. When the session is created again for the same input,
+// output and quality, it seeks the input to the first unfinished segment and continues from
+// there. Because each segment only depends on the input, a resumed encode produces the same audio
+// data as one that was never interrupted.
+//
+// The checkpoint file is little-endian, and contains the magic "MFCK", followed by the version
+// (1), the input file size and last write time as UINT64, and the average bytes per second, sample
+// rate, channel count, segment frames, completed segment count and a flag indicating the last
+// segment is done, all as UINT32.
+class ResumableTranscodeSession final
+{
+public:
+    ResumableTranscodeSession(MediaSource &source, const std::filesystem::path &input,
+                              const std::filesystem::path &output, int quality);
+
+    void Start();
+    bool Wait(std::chrono::milliseconds timeout);
+    async::CompletionEvent &Completed();
+    util::WindowsTimeUnits GetPosition() const;
+    util::WindowsTimeUnits GetDuration() const;
+    float GetProgress() const;
+
+    // Returns the duration of the input that was already encoded by an earlier run.
+    util::WindowsTimeUnits GetResumedPosition() const;
+    // Returns true if a checkpoint of an earlier run with the same input and settings was found.
+    // The output may then hold a partial result of that run, which this session replaces.
+    bool IsResuming() const;
+
+private:
+    struct Checkpoint
+    {
+        UINT64 InputSize;
+        UINT64 InputLastWriteTime;
+        UINT32 AvgBytesPerSecond;
+        UINT32 SamplesPerSecond;
+        UINT32 Channels;
+        UINT32 SegmentFrames;
+        UINT32 CompletedSegments;
+        UINT32 Finished;
+    };
+
+    void Run(std::stop_token stopToken);
+    bool EncodeSegments(std::stop_token stopToken);
+    std::optional<Checkpoint> LoadCheckpoint() const;
+    void SaveCheckpoint() const;
+    std::filesystem::path GetSegmentPath(UINT32 segment) const;
+    void Cleanup();
+
+    std::filesystem::path m_output;
+    std::filesystem::path m_checkpointPath;
+    SourceReaderInput m_reader;
+    Checkpoint m_checkpoint{};
+    std::atomic<UINT64> m_frames{};
+    util::WindowsTimeUnits m_duration{};
+    bool m_resuming{};
+    SessionWorker m_worker;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,308 @@
+#include "precomp.h"
+#include "silence.h"
+#include "simd.h"
+
+namespace audio
+{
+
+constexpr UINT32 c_silenceWindowsPerSecond = 100;
+constexpr double c_silencePeakMargin = 20.0;
+// Held back silence beyond this number of samples is moved to a temporary file.
+constexpr size_t c_maxPendingSamples = 0x400000;
+
+SilenceDetector::SilenceDetector(const AudioFormat &format, double thresholdDb, util::WindowsTimeUnits minimumDuration)
+    : m_format{format},
+      m_windowFrames{format.SamplesPerSecond / c_silenceWindowsPerSecond},
+      m_minimumFrames{static_cast<UINT64>(minimumDuration.count()) * format.SamplesPerSecond / wil::filetime_duration::one_second},
+      m_rmsThreshold{DecibelsToGain(thresholdDb)},
+      m_peakThreshold{DecibelsToGain(thresholdDb + c_silencePeakMargin)}
+{
+}
+
+void SilenceDetector::ProcessSamples(std::span<const float> samples)
+{
+    // Both reductions are over all channels, so the samples can be treated as a flat array.
+    while (samples.size() >= m_format.Channels)
+    {
+        auto frames = std::min(samples.size() / m_format.Channels, m_windowFrames - m_windowPosition);
+        auto count = frames * m_format.Channels;
+        const float *input = samples.data();
+        auto sum = simd::Set1(0.0f);
+        auto peak = simd::Set1(0.0f);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            auto value = simd::Load(input + i);
+            sum = simd::MulAdd(value, value, sum);
+            peak = simd::Max(peak, simd::Abs(value));
+        }
+
+        m_sumOfSquares += simd::HorizontalSum(sum);
+        m_peak = std::max(m_peak, simd::HorizontalMax(peak));
+        for (; i < count; ++i)
+        {
+            m_sumOfSquares += input[i] * input[i];
+            m_peak = std::max(m_peak, std::abs(input[i]));
+        }
+
+        samples = samples.subspan(count);
+        m_windowPosition += frames;
+        if (m_windowPosition == m_windowFrames)
+        {
+            EndWindow();
+        }
+    }
+}
+
+std::vector<SilentRange> SilenceDetector::GetSilentRanges() const
+{
+    auto result = m_ranges;
+    auto end = m_windowStart + m_windowPosition;
+    if (!IsPartialWindowSilent())
+    {
+        end = m_windowStart;
+    }
+
+    if (m_inSilence && end - m_silenceStart >= m_minimumFrames)
+    {
+        result.push_back({ m_silenceStart, end });
+    }
+
+    return result;
+}
+
+bool SilenceDetector::IsLastWindowSilent() const
+{
+    return m_lastWindowSilent;
+}
+
+bool SilenceDetector::IsPartialWindowSilent() const
+{
+    return m_windowPosition == 0 || IsSilent(m_windowPosition);
+}
+
+size_t SilenceDetector::GetWindowFrames() const
+{
+    return m_windowFrames;
+}
+
+bool SilenceDetector::IsSilent(size_t frames) const
+{
+    auto rms = std::sqrt(m_sumOfSquares / (frames * m_format.Channels));
+    return rms < m_rmsThreshold && m_peak < m_peakThreshold;
+}
+
+void SilenceDetector::EndWindow()
+{
+    m_lastWindowSilent = IsSilent(m_windowFrames);
+    if (m_lastWindowSilent && !m_inSilence)
+    {
+        m_inSilence = true;
+        m_silenceStart = m_windowStart;
+    }
+    else if (!m_lastWindowSilent && m_inSilence)
+    {
+        m_inSilence = false;
+        if (m_windowStart - m_silenceStart >= m_minimumFrames)
+        {
+            m_ranges.push_back({ m_silenceStart, m_windowStart });
+        }
+    }
+
+    m_windowStart += m_windowFrames;
+    m_windowPosition = 0;
+    m_sumOfSquares = 0.0;
+    m_peak = 0.0f;
+}
+
+SilenceTrimmingReader::SilenceTrimmingReader(ISampleReader &reader, SilenceDetector &detector)
+    : m_reader{reader},
+      m_detector{detector},
+      m_format{reader.GetFormat()},
+      m_window(detector.GetWindowFrames() * reader.GetFormat().Channels)
+{
+}
+
+std::span<const float> SilenceTrimmingReader::ReadBlock()
+{
+    for (;;)
+    {
+        if (m_replaying)
+        {
+            auto samples = ReplaySilence();
+            if (!samples.empty())
+            {
+                return Output(samples);
+            }
+        }
+
+        if (m_holdingWindow)
+        {
+            m_holdingWindow = false;
+            return Output({ m_window.data(), m_windowFill * m_format.Channels });
+        }
+
+        if (m_ended)
+        {
+            return {};
+        }
+
+        // Windows are aligned with the detector's windows, so each full window is classified
+        // as soon as it's passed to the detector.
+        bool complete = FillWindow();
+        std::span<const float> window{ m_window.data(), m_windowFill * m_format.Channels };
+        m_detector.ProcessSamples(window);
+        // The last window is usually shorter than the others, so it's classified over just the
+        // frames it has. If it isn't silent, it's kept along with any silence before it.
+        if (!complete)
+        {
+            m_ended = true;
+            if (m_detector.IsPartialWindowSilent())
+            {
+                if (m_audioStarted)
+                {
+                    m_trailingFrames += m_pendingFrames + m_windowFill;
+                    m_pending.clear();
+                    m_pendingCache.reset();
+                    m_pendingFrames = 0;
+                }
+                else
+                {
+                    m_leadingFrames += m_windowFill;
+                }
+
+                return {};
+            }
+        }
+        else if (m_detector.IsLastWindowSilent())
+        {
+            if (m_audioStarted)
+            {
+                HoldSilence(window);
+            }
+            else
+            {
+                m_leadingFrames += m_windowFill;
+            }
+
+            continue;
+        }
+
+        m_audioStarted = true;
+        if (m_pendingFrames > 0)
+        {
+            m_replaying = true;
+            m_holdingWindow = true;
+            continue;
+        }
+
+        return Output(window);
+    }
+}
+
+AudioFormat SilenceTrimmingReader::GetFormat() const
+{
+    return m_format;
+}
+
+util::WindowsTimeUnits SilenceTrimmingReader::GetDuration() const
+{
+    // The amount of trailing silence isn't known until the end, so this is the input duration.
+    return m_reader.GetDuration();
+}
+
+UINT64 SilenceTrimmingReader::GetLeadingFrames() const
+{
+    return m_leadingFrames;
+}
+
+UINT64 SilenceTrimmingReader::GetTrailingFrames() const
+{
+    return m_trailingFrames;
+}
+
+UINT64 SilenceTrimmingReader::GetOutputFrames() const
+{
+    return m_outputFrames;
+}
+
+bool SilenceTrimmingReader::FillWindow()
+{
+    size_t filled = 0;
+    while (filled < m_window.size())
+    {
+        if (m_input.empty())
+        {
+            m_input = m_reader.ReadBlock();
+            if (m_input.empty())
+            {
+                break;
+            }
+        }
+
+        auto count = std::min(m_window.size() - filled, m_input.size());
+        std::copy_n(m_input.data(), count, m_window.data() + filled);
+        m_input = m_input.subspan(count);
+        filled += count;
+    }
+
+    m_windowFill = filled / m_format.Channels;
+    return filled == m_window.size();
+}
+
+void SilenceTrimmingReader::HoldSilence(std::span<const float> samples)
+{
+    m_pending.insert(m_pending.end(), samples.begin(), samples.end());
+    m_pendingFrames += samples.size() / m_format.Channels;
+    if (m_pending.size() >= c_maxPendingSamples)
+    {
+        if (!m_pendingCache)
+        {
+            m_pendingCache.emplace(m_format);
+        }
+
+        m_pendingCache->ProcessSamples(m_pending);
+        m_pending.clear();
+    }
+}
+
+std::span<const float> SilenceTrimmingReader::ReplaySilence()
+{
+    if (m_pendingCache)
+    {
+        if (!m_replayReader)
+        {
+            m_pendingCache->ProcessSamples(m_pending);
+            m_pending.clear();
+            m_replayReader = m_pendingCache->CreateReader();
+        }
+
+        auto samples = m_replayReader->ReadBlock();
+        if (!samples.empty())
+        {
+            return samples;
+        }
+
+        m_replayReader.reset();
+        m_pendingCache.reset();
+    }
+    else if (!m_pending.empty())
+    {
+        // Swap the buffers so the returned samples stay valid until the next call.
+        m_replayBuffer.swap(m_pending);
+        m_pending.clear();
+        return m_replayBuffer;
+    }
+
+    m_replaying = false;
+    m_pendingFrames = 0;
+    return {};
+}
+
+std::span<const float> SilenceTrimmingReader::Output(std::span<const float> samples)
+{
+    m_outputFrames += samples.size() / m_format.Channels;
+    return samples;
+}
+
+}
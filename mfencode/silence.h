@@ -0,0 +1,93 @@
+#pragma once
+
+#include "audio.h"
+
+namespace audio
+{
+
+struct SilentRange
+{
+    UINT64 StartFrame;
+    UINT64 EndFrame;
+};
+
+// Classifies fixed 10ms windows as silent or not, and keeps track of the silent ranges that are at
+// least the minimum duration. A window is silent if its RMS level is below the threshold, and its
+// peak level is no more than 20dB above it, so low-level noise is tolerated but clicks are not.
+class SilenceDetector final : public ISampleProcessor
+{
+public:
+    SilenceDetector(const AudioFormat &format, double thresholdDb, util::WindowsTimeUnits minimumDuration);
+
+    void ProcessSamples(std::span<const float> samples) override;
+
+    // Returns the silent ranges found so far, including a silent range at the end of the stream.
+    std::vector<SilentRange> GetSilentRanges() const;
+    bool IsLastWindowSilent() const;
+    // Returns whether the frames of the window that is not yet complete are silent. This is true
+    // if there are no such frames.
+    bool IsPartialWindowSilent() const;
+    size_t GetWindowFrames() const;
+
+private:
+    bool IsSilent(size_t frames) const;
+    void EndWindow();
+
+    AudioFormat m_format;
+    size_t m_windowFrames;
+    UINT64 m_minimumFrames;
+    float m_rmsThreshold;
+    float m_peakThreshold;
+    std::vector<SilentRange> m_ranges;
+    UINT64 m_windowStart{};
+    size_t m_windowPosition{};
+    double m_sumOfSquares{};
+    float m_peak{};
+    bool m_lastWindowSilent{};
+    bool m_inSilence{};
+    UINT64 m_silenceStart{};
+};
+
+// Removes leading and trailing silence from the samples provided by another reader. Silence in the
+// middle of the stream is held back until the end of the stream is known not to follow it, and is
+// spilled to a temporary file if it gets long.
+class SilenceTrimmingReader final : public ISampleReader
+{
+public:
+    SilenceTrimmingReader(ISampleReader &reader, SilenceDetector &detector);
+
+    std::span<const float> ReadBlock() override;
+    AudioFormat GetFormat() const override;
+    util::WindowsTimeUnits GetDuration() const override;
+
+    UINT64 GetLeadingFrames() const;
+    UINT64 GetTrailingFrames() const;
+    UINT64 GetOutputFrames() const;
+
+private:
+    bool FillWindow();
+    void HoldSilence(std::span<const float> samples);
+    std::span<const float> ReplaySilence();
+    std::span<const float> Output(std::span<const float> samples);
+
+    ISampleReader &m_reader;
+    SilenceDetector &m_detector;
+    AudioFormat m_format;
+    std::span<const float> m_input;
+    std::vector<float> m_window;
+    size_t m_windowFill{};
+    std::vector<float> m_pending;
+    std::vector<float> m_replayBuffer;
+    UINT64 m_pendingFrames{};
+    std::optional<PcmCache> m_pendingCache;
+    std::unique_ptr<ISampleReader> m_replayReader;
+    bool m_replaying{};
+    bool m_holdingWindow{};
+    bool m_audioStarted{};
+    bool m_ended{};
+    UINT64 m_leadingFrames{};
+    UINT64 m_trailingFrames{};
+    UINT64 m_outputFrames{};
+};
+
+}
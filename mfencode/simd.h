@@ -0,0 +1,160 @@
+#pragma once
+
+// Minimal SIMD abstraction used by the sample processors. SSE2 is used on x86 and x64 (it is the
+// baseline for both), and NEON on ARM64. A scalar fallback keeps other targets compiling.
+#if defined(_M_X64) || defined(_M_IX86)
+#define MFENCODE_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(_M_ARM64)
+#define MFENCODE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace simd
+{
+
+#if defined(MFENCODE_SIMD_SSE2)
+
+struct float4 { __m128 v; };
+struct double2 { __m128d v; };
+
+inline float4 Load(const float *p) { return {_mm_loadu_ps(p)}; }
+inline void Store(float *p, float4 a) { _mm_storeu_ps(p, a.v); }
+inline float4 Set1(float value) { return {_mm_set1_ps(value)}; }
+inline float4 Set(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+inline float4 Add(float4 a, float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline float4 Mul(float4 a, float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline float4 MulAdd(float4 a, float4 b, float4 c) { return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)}; }
+inline float4 Min(float4 a, float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline float4 Max(float4 a, float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline float4 Abs(float4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+
+// Converts eight floats to 16-bit integers with saturation, rounding to nearest.
+inline void StoreInt16(int16_t *p, float4 low, float4 high)
+{
+    auto packed = _mm_packs_epi32(_mm_cvtps_epi32(low.v), _mm_cvtps_epi32(high.v));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), packed);
+}
+
+inline double2 Load(const double *p) { return {_mm_loadu_pd(p)}; }
+inline void Store(double *p, double2 a) { _mm_storeu_pd(p, a.v); }
+inline double2 Set1(double value) { return {_mm_set1_pd(value)}; }
+inline double2 Set(double a, double b) { return {_mm_setr_pd(a, b)}; }
+inline double2 Add(double2 a, double2 b) { return {_mm_add_pd(a.v, b.v)}; }
+inline double2 Sub(double2 a, double2 b) { return {_mm_sub_pd(a.v, b.v)}; }
+inline double2 Mul(double2 a, double2 b) { return {_mm_mul_pd(a.v, b.v)}; }
+inline double2 MulAdd(double2 a, double2 b, double2 c) { return {_mm_add_pd(_mm_mul_pd(a.v, b.v), c.v)}; }
+
+// Loads two adjacent floats and widens them to doubles.
+inline double2 LoadFloat2(const float *p)
+{
+    return {_mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(p))))};
+}
+
+#elif defined(MFENCODE_SIMD_NEON)
+
+struct float4 { float32x4_t v; };
+struct double2 { float64x2_t v; };
+
+inline float4 Load(const float *p) { return {vld1q_f32(p)}; }
+inline void Store(float *p, float4 a) { vst1q_f32(p, a.v); }
+inline float4 Set1(float value) { return {vdupq_n_f32(value)}; }
+inline float4 Set(float a, float b, float c, float d)
+{
+    const float values[] = { a, b, c, d };
+    return {vld1q_f32(values)};
+}
+
+inline float4 Add(float4 a, float4 b) { return {vaddq_f32(a.v, b.v)}; }
+inline float4 Mul(float4 a, float4 b) { return {vmulq_f32(a.v, b.v)}; }
+inline float4 MulAdd(float4 a, float4 b, float4 c) { return {vmlaq_f32(c.v, a.v, b.v)}; }
+inline float4 Min(float4 a, float4 b) { return {vminq_f32(a.v, b.v)}; }
+inline float4 Max(float4 a, float4 b) { return {vmaxq_f32(a.v, b.v)}; }
+inline float4 Abs(float4 a) { return {vabsq_f32(a.v)}; }
+
+inline void StoreInt16(int16_t *p, float4 low, float4 high)
+{
+    auto packed = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(low.v)), vqmovn_s32(vcvtnq_s32_f32(high.v)));
+    vst1q_s16(p, packed);
+}
+
+inline double2 Load(const double *p) { return {vld1q_f64(p)}; }
+inline void Store(double *p, double2 a) { vst1q_f64(p, a.v); }
+inline double2 Set1(double value) { return {vdupq_n_f64(value)}; }
+inline double2 Set(double a, double b)
+{
+    const double values[] = { a, b };
+    return {vld1q_f64(values)};
+}
+
+inline double2 Add(double2 a, double2 b) { return {vaddq_f64(a.v, b.v)}; }
+inline double2 Sub(double2 a, double2 b) { return {vsubq_f64(a.v, b.v)}; }
+inline double2 Mul(double2 a, double2 b) { return {vmulq_f64(a.v, b.v)}; }
+inline double2 MulAdd(double2 a, double2 b, double2 c) { return {vfmaq_f64(c.v, a.v, b.v)}; }
+inline double2 LoadFloat2(const float *p) { return {vcvt_f64_f32(vld1_f32(p))}; }
+
+#else
+
+struct float4 { float v[4]; };
+struct double2 { double v[2]; };
+
+inline float4 Load(const float *p) { return {{ p[0], p[1], p[2], p[3] }}; }
+inline void Store(float *p, float4 a) { std::copy_n(a.v, 4, p); }
+inline float4 Set1(float value) { return {{ value, value, value, value }}; }
+inline float4 Set(float a, float b, float c, float d) { return {{ a, b, c, d }}; }
+inline float4 Add(float4 a, float4 b) { return {{ a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] }}; }
+inline float4 Mul(float4 a, float4 b) { return {{ a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] }}; }
+inline float4 MulAdd(float4 a, float4 b, float4 c) { return Add(Mul(a, b), c); }
+inline float4 Min(float4 a, float4 b) { return {{ std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3]) }}; }
+inline float4 Max(float4 a, float4 b) { return {{ std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) }}; }
+inline float4 Abs(float4 a) { return {{ std::abs(a.v[0]), std::abs(a.v[1]), std::abs(a.v[2]), std::abs(a.v[3]) }}; }
+
+inline void StoreInt16(int16_t *p, float4 low, float4 high)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        p[i] = static_cast<int16_t>(std::clamp(std::lround(low.v[i]), -32768L, 32767L));
+        p[i + 4] = static_cast<int16_t>(std::clamp(std::lround(high.v[i]), -32768L, 32767L));
+    }
+}
+
+inline double2 Load(const double *p) { return {{ p[0], p[1] }}; }
+inline void Store(double *p, double2 a) { p[0] = a.v[0]; p[1] = a.v[1]; }
+inline double2 Set1(double value) { return {{ value, value }}; }
+inline double2 Set(double a, double b) { return {{ a, b }}; }
+inline double2 Add(double2 a, double2 b) { return {{ a.v[0] + b.v[0], a.v[1] + b.v[1] }}; }
+inline double2 Sub(double2 a, double2 b) { return {{ a.v[0] - b.v[0], a.v[1] - b.v[1] }}; }
+inline double2 Mul(double2 a, double2 b) { return {{ a.v[0] * b.v[0], a.v[1] * b.v[1] }}; }
+inline double2 MulAdd(double2 a, double2 b, double2 c) { return Add(Mul(a, b), c); }
+inline double2 LoadFloat2(const float *p) { return {{ p[0], p[1] }}; }
+
+#endif
+
+// Loads a single float into the low lane, with the high lane set to zero.
+inline double2 LoadFloat1(const float *p)
+{
+    return Set(*p, 0.0);
+}
+
+inline float HorizontalMin(float4 a)
+{
+    float values[4];
+    Store(values, a);
+    return std::min(std::min(values[0], values[1]), std::min(values[2], values[3]));
+}
+
+inline float HorizontalMax(float4 a)
+{
+    float values[4];
+    Store(values, a);
+    return std::max(std::max(values[0], values[1]), std::max(values[2], values[3]));
+}
+
+inline float HorizontalSum(float4 a)
+{
+    float values[4];
+    Store(values, a);
+    return (values[0] + values[1]) + (values[2] + values[3]);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,329 @@
+#include "async.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+// A minimal test harness, so the tests don't need anything beyond the standard library.
+int g_failures{};
+
+void Check(bool condition, const char *expression, const char *file, int line)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+        ++g_failures;
+    }
+}
+
+#define CHECK(condition) Check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+template<typename Exception, typename Function>
+bool Throws(Function function)
+{
+    try
+    {
+        function();
+    }
+    catch (const Exception &)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+async::Task<int> GetValue(int value)
+{
+    co_return value;
+}
+
+async::Task<> AddValues(std::vector<int> &results, int first, int second)
+{
+    results.push_back(co_await GetValue(first) + co_await GetValue(second));
+}
+
+async::Task<> Throw()
+{
+    throw std::runtime_error{"task failed"};
+    co_return;
+}
+
+async::Task<> SetAfterThrow(bool &ran)
+{
+    ran = true;
+    co_return;
+}
+
+async::Task<> RecordAfterDelay(async::Executor &executor, std::vector<int> &order, int id,
+                               std::chrono::milliseconds delay)
+{
+    co_await executor.Delay(delay);
+    order.push_back(id);
+}
+
+async::Task<> SwitchThreads(async::Executor &executor, async::ThreadPool &pool, std::thread::id &poolThread,
+                            std::thread::id &executorThread)
+{
+    co_await pool.Schedule();
+    poolThread = std::this_thread::get_id();
+    co_await executor.Schedule();
+    executorThread = std::this_thread::get_id();
+}
+
+async::Task<> WaitForEvent(async::CompletionEvent &event, std::thread::id &resumedThread, std::string &error)
+{
+    try
+    {
+        co_await event;
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+    }
+
+    resumedThread = std::this_thread::get_id();
+}
+
+// A stand-in for a session whose events are raised on another thread, like a Media Foundation
+// session.
+struct FakeSession
+{
+    std::atomic<float> Progress{};
+    async::CompletionEvent Completed;
+    bool Fail{};
+};
+
+// Completes sessions from a single thread, in reverse order, reporting progress before each one,
+// the way the media session's work queue raises events for every session in the process.
+class FakeSessionSource
+{
+public:
+    explicit FakeSessionSource(std::vector<std::unique_ptr<FakeSession>> &sessions)
+        : m_thread{[&sessions]()
+          {
+              for (auto it = sessions.rbegin(); it != sessions.rend(); ++it)
+              {
+                  auto &session = **it;
+                  for (int step = 1; step <= 4; ++step)
+                  {
+                      session.Progress = step / 4.0f;
+                      std::this_thread::sleep_for(100us);
+                  }
+
+                  session.Completed.SetCompleted(
+                      session.Fail ? std::make_exception_ptr(std::runtime_error{"session failed"}) : nullptr);
+              }
+          }}
+    {
+    }
+
+private:
+    std::jthread m_thread;
+};
+
+struct SessionResults
+{
+    std::thread::id ExecutorThread;
+    size_t Completed{};
+    size_t Failed{};
+    size_t WrongThread{};
+};
+
+async::Task<> RunFakeSession(FakeSession &session, SessionResults &results)
+{
+    try
+    {
+        co_await session.Completed;
+        ++results.Completed;
+    }
+    catch (const std::runtime_error &)
+    {
+        ++results.Failed;
+    }
+
+    if (std::this_thread::get_id() != results.ExecutorThread || session.Progress != 1.0f)
+    {
+        ++results.WrongThread;
+    }
+}
+
+void ExecutorRunsSpawnedTasksToCompletion()
+{
+    async::Executor executor;
+    std::vector<int> results;
+    executor.Spawn(AddValues(results, 1, 2));
+    executor.Spawn(AddValues(results, 3, 4));
+    executor.Run();
+
+    CHECK((results == std::vector<int>{ 3, 7 }));
+}
+
+void ExecutorRunReturnsWithoutTasks()
+{
+    async::Executor executor;
+    executor.Run();
+}
+
+void ExecutorRunRethrowsTaskException()
+{
+    async::Executor executor;
+    bool ran = false;
+    executor.Spawn(Throw());
+    executor.Spawn(SetAfterThrow(ran));
+
+    CHECK(Throws<std::runtime_error>([&executor]() { executor.Run(); }));
+    CHECK(ran);
+
+    // The exception is only reported once.
+    executor.Run();
+}
+
+void ExecutorDelayResumesInOrderOfDueTime()
+{
+    async::Executor executor;
+    std::vector<int> order;
+    auto start = std::chrono::steady_clock::now();
+    executor.Spawn(RecordAfterDelay(executor, order, 1, 60ms));
+    executor.Spawn(RecordAfterDelay(executor, order, 2, 20ms));
+    executor.Spawn(RecordAfterDelay(executor, order, 3, 40ms));
+    executor.Run();
+
+    CHECK((order == std::vector<int>{ 2, 3, 1 }));
+    CHECK(std::chrono::steady_clock::now() - start >= 60ms);
+}
+
+void ThreadPoolScheduleMovesToPoolAndBack()
+{
+    async::Executor executor;
+    async::ThreadPool pool{2};
+    std::thread::id poolThread;
+    std::thread::id executorThread;
+    executor.Spawn(SwitchThreads(executor, pool, poolThread, executorThread));
+    executor.Run();
+
+    CHECK(std::this_thread::get_id() != poolThread);
+    CHECK(std::thread::id{} != poolThread);
+    CHECK(std::this_thread::get_id() == executorThread);
+}
+
+void CompletionEventAlreadyCompletedDoesNotSuspend()
+{
+    async::Executor executor;
+    async::CompletionEvent event;
+    event.SetCompleted();
+    std::thread::id resumedThread;
+    std::string error;
+    executor.Spawn(WaitForEvent(event, resumedThread, error));
+    executor.Run();
+
+    CHECK(event.IsCompleted());
+    CHECK(std::this_thread::get_id() == resumedThread);
+    CHECK(error.empty());
+}
+
+void CompletionEventCompletedFromOtherThreadResumesOnExecutor()
+{
+    async::Executor executor;
+    async::CompletionEvent event;
+    std::thread::id resumedThread;
+    std::string error;
+    executor.Spawn(WaitForEvent(event, resumedThread, error));
+    std::jthread completer{[&event]()
+    {
+        std::this_thread::sleep_for(20ms);
+        event.SetCompleted();
+    }};
+
+    executor.Run();
+
+    CHECK(std::this_thread::get_id() == resumedThread);
+    CHECK(error.empty());
+}
+
+void CompletionEventExceptionIsRethrownToWaiters()
+{
+    async::Executor executor;
+    async::CompletionEvent event;
+    std::thread::id firstThread;
+    std::thread::id secondThread;
+    std::string firstError;
+    std::string secondError;
+    executor.Spawn(WaitForEvent(event, firstThread, firstError));
+    executor.Spawn(WaitForEvent(event, secondThread, secondError));
+    std::jthread completer{[&event]()
+    {
+        std::this_thread::sleep_for(20ms);
+        event.SetCompleted(std::make_exception_ptr(std::runtime_error{"failed"}));
+        // Only the first completion counts.
+        event.SetCompleted();
+    }};
+
+    executor.Run();
+
+    CHECK("failed" == firstError);
+    CHECK("failed" == secondError);
+    CHECK(std::this_thread::get_id() == firstThread);
+    CHECK(std::this_thread::get_id() == secondThread);
+}
+
+void FakeSessionCompletesManySessionsFromOneThread()
+{
+    constexpr size_t sessionCount = 64;
+    std::vector<std::unique_ptr<FakeSession>> sessions;
+    for (size_t i = 0; i < sessionCount; ++i)
+    {
+        sessions.push_back(std::make_unique<FakeSession>());
+        sessions.back()->Fail = i % 8 == 0;
+    }
+
+    async::Executor executor;
+    SessionResults results;
+    results.ExecutorThread = std::this_thread::get_id();
+    for (auto &session : sessions)
+    {
+        executor.Spawn(RunFakeSession(*session, results));
+    }
+
+    {
+        FakeSessionSource source{sessions};
+        executor.Run();
+    }
+
+    CHECK(sessionCount - sessionCount / 8 == results.Completed);
+    CHECK(sessionCount / 8 == results.Failed);
+    CHECK(0u == results.WrongThread);
+}
+
+}
+
+int main()
+{
+    const std::pair<const char *, void (*)()> tests[] = {
+        { "ExecutorRunsSpawnedTasksToCompletion", ExecutorRunsSpawnedTasksToCompletion },
+        { "ExecutorRunReturnsWithoutTasks", ExecutorRunReturnsWithoutTasks },
+        { "ExecutorRunRethrowsTaskException", ExecutorRunRethrowsTaskException },
+        { "ExecutorDelayResumesInOrderOfDueTime", ExecutorDelayResumesInOrderOfDueTime },
+        { "ThreadPoolScheduleMovesToPoolAndBack", ThreadPoolScheduleMovesToPoolAndBack },
+        { "CompletionEventAlreadyCompletedDoesNotSuspend", CompletionEventAlreadyCompletedDoesNotSuspend },
+        { "CompletionEventCompletedFromOtherThreadResumesOnExecutor", CompletionEventCompletedFromOtherThreadResumesOnExecutor },
+        { "CompletionEventExceptionIsRethrownToWaiters", CompletionEventExceptionIsRethrownToWaiters },
+        { "FakeSessionCompletesManySessionsFromOneThread", FakeSessionCompletesManySessionsFromOneThread },
+    };
+
+    for (auto [name, test] : tests)
+    {
+        auto failures = g_failures;
+        test();
+        std::printf("%s %s\n", g_failures == failures ? "PASS" : "FAIL", name);
+    }
+
+    return g_failures == 0 ? 0 : 1;
+}